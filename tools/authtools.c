@@ -0,0 +1,1226 @@
+// libauthtools implementation: base64url/base32 decoding, constant-time
+// comparison, the reusable HMAC engine, and the TOTP primitives. The CLIs
+// in jwt_verify.c and totp_tool.c are thin wrappers over these.
+
+#include "authtools.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#include <immintrin.h>
+// SHA-NI kernels are compiled with a per-function target attribute so the
+// library still builds (and falls back cleanly) without -msha. They must
+// stay out of line, and when the rest of the TU is built with AVX
+// enabled (-march=native, PGO builds) they clear the upper ymm state on
+// entry: SHA-NI instructions only have legacy SSE encodings, and running
+// them while a caller's vectorized code has dirtied the uppers makes
+// every SHA op pay the SSE/AVX transition penalty (~100x on
+// Skylake-class parts).
+#define AUTHTOOLS_SHA_HW 1
+#define AUTHTOOLS_SHA_TARGET \
+    __attribute__((noinline, target("sha,sse4.1")))
+#ifdef __AVX__
+#define AUTHTOOLS_SHA_CLEAN_UPPERS() __asm__ volatile("vzeroupper")
+#else
+#define AUTHTOOLS_SHA_CLEAN_UPPERS() ((void)0)
+#endif
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRYPTO)
+#include <arm_neon.h>
+#include <sys/auxv.h>
+#define AUTHTOOLS_SHA_HW 1
+#define AUTHTOOLS_SHA_TARGET
+#endif
+
+// base64url decode table: 6-bit value per byte, -1 = invalid, -2 = '=' pad
+static const signed char B64URL_TABLE[256] = {
+     -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,
+     -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,
+     -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  62,  -1,  -1,
+     52,  53,  54,  55,  56,  57,  58,  59,  60,  61,  -1,  -1,  -1,  -2,  -1,  -1,
+     -1,   0,   1,   2,   3,   4,   5,   6,   7,   8,   9,  10,  11,  12,  13,  14,
+     15,  16,  17,  18,  19,  20,  21,  22,  23,  24,  25,  -1,  -1,  -1,  -1,  63,
+     -1,  26,  27,  28,  29,  30,  31,  32,  33,  34,  35,  36,  37,  38,  39,  40,
+     41,  42,  43,  44,  45,  46,  47,  48,  49,  50,  51,  -1,  -1,  -1,  -1,  -1,
+     -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,
+     -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,
+     -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,
+     -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,
+     -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,
+     -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,
+     -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,
+     -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,
+};
+
+int b64url_decode_buf(const char *input, size_t in_len, unsigned char *out,
+                      size_t out_cap, size_t *out_len) {
+    // trailing '=' padding is optional; strip it up front
+    while (in_len > 0 && input[in_len - 1] == '=') --in_len;
+
+    size_t full = in_len / 4;
+    size_t rem = in_len % 4;
+    if (rem == 1) return -1; // no valid encoding leaves 1 trailing char
+    size_t need = full * 3 + (rem == 3 ? 2 : rem == 2 ? 1 : 0);
+    if (need > out_cap) return -1;
+
+    const unsigned char *p = (const unsigned char *)input;
+    unsigned char *q = out;
+    for (size_t i = 0; i < full; ++i) {
+        int a = B64URL_TABLE[p[0]], b = B64URL_TABLE[p[1]];
+        int c = B64URL_TABLE[p[2]], d = B64URL_TABLE[p[3]];
+        if ((a | b | c | d) < 0) return -1;
+        uint32_t v = (uint32_t)a << 18 | (uint32_t)b << 12 | (uint32_t)c << 6 | (uint32_t)d;
+        q[0] = (unsigned char)(v >> 16);
+        q[1] = (unsigned char)(v >> 8);
+        q[2] = (unsigned char)v;
+        p += 4;
+        q += 3;
+    }
+    if (rem == 2) {
+        int a = B64URL_TABLE[p[0]], b = B64URL_TABLE[p[1]];
+        if ((a | b) < 0) return -1;
+        *q++ = (unsigned char)((uint32_t)a << 2 | (uint32_t)b >> 4);
+    } else if (rem == 3) {
+        int a = B64URL_TABLE[p[0]], b = B64URL_TABLE[p[1]], c = B64URL_TABLE[p[2]];
+        if ((a | b | c) < 0) return -1;
+        uint32_t v = (uint32_t)a << 12 | (uint32_t)b << 6 | (uint32_t)c;
+        *q++ = (unsigned char)(v >> 10);
+        *q++ = (unsigned char)(v >> 2);
+    }
+    *out_len = q - out;
+    return 0;
+}
+
+// base32 decode table: 5-bit value per byte, case-insensitive; -1 = invalid
+// (skipped), -2 = '='/' ' terminator
+static const signed char BASE32_TABLE[256] = {
+     -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,
+     -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,
+     -2,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,
+     -1,  -1,  26,  27,  28,  29,  30,  31,  -1,  -1,  -1,  -1,  -1,  -2,  -1,  -1,
+     -1,   0,   1,   2,   3,   4,   5,   6,   7,   8,   9,  10,  11,  12,  13,  14,
+     15,  16,  17,  18,  19,  20,  21,  22,  23,  24,  25,  -1,  -1,  -1,  -1,  -1,
+     -1,   0,   1,   2,   3,   4,   5,   6,   7,   8,   9,  10,  11,  12,  13,  14,
+     15,  16,  17,  18,  19,  20,  21,  22,  23,  24,  25,  -1,  -1,  -1,  -1,  -1,
+     -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,
+     -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,
+     -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,
+     -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,
+     -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,
+     -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,
+     -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,
+     -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,
+};
+
+int base32_decode_buf(const char *encoded, unsigned char *out, size_t out_cap,
+                      size_t *out_len) {
+    uint32_t buffer = 0;
+    int bits_left = 0;
+    size_t count = 0;
+    for (const unsigned char *p = (const unsigned char *)encoded; *p; ++p) {
+        int val = BASE32_TABLE[*p];
+        if (val == -2) break;    // padding or separator
+        if (val < 0) continue;   // skip invalid
+        buffer = buffer << 5 | (uint32_t)val;
+        bits_left += 5;
+        if (bits_left >= 8) {
+            if (count == out_cap) return -1;
+            out[count++] = (buffer >> (bits_left - 8)) & 0xFF;
+            bits_left -= 8;
+        }
+    }
+    *out_len = count;
+    return 0;
+}
+
+int base32_decode(const char *encoded, unsigned char **result, size_t *out_len) {
+    size_t len = strlen(encoded);
+    unsigned char *bytes = malloc((len * 5 / 8) + 1);
+    if (!bytes) return -1;
+    if (base32_decode_buf(encoded, bytes, (len * 5 / 8) + 1, out_len) != 0) {
+        free(bytes);
+        return -1;
+    }
+    *result = bytes;
+    return 0;
+}
+
+#define ARENA_DEFAULT_CHUNK (64 * 1024)
+
+struct arena_chunk {
+    arena_chunk *next;
+    size_t used;
+    size_t cap;
+    unsigned char data[];
+};
+
+static arena_chunk *arena_chunk_new(size_t cap) {
+    arena_chunk *c = malloc(sizeof(arena_chunk) + cap);
+    if (!c) return NULL;
+    c->next = NULL;
+    c->used = 0;
+    c->cap = cap;
+    return c;
+}
+
+void arena_init(bump_arena *a, size_t chunk_size) {
+    a->head = a->chunks = NULL;
+    a->chunk_size = chunk_size ? chunk_size : ARENA_DEFAULT_CHUNK;
+}
+
+void *arena_alloc(bump_arena *a, size_t size) {
+    size = (size + 7) & ~(size_t)7;
+    if (a->head && a->head->used + size <= a->head->cap) {
+        void *p = a->head->data + a->head->used;
+        a->head->used += size;
+        return p;
+    }
+    // try the next already-allocated chunk (present after a reset)
+    if (a->head && a->head->next && size <= a->head->next->cap) {
+        a->head = a->head->next;
+        void *p = a->head->data;
+        a->head->used = size;
+        return p;
+    }
+    size_t cap = size > a->chunk_size ? size : a->chunk_size;
+    arena_chunk *c = arena_chunk_new(cap);
+    if (!c) return NULL;
+    if (a->head) {
+        c->next = a->head->next;
+        a->head->next = c;
+    } else {
+        a->chunks = c;
+    }
+    a->head = c;
+    c->used = size;
+    return c->data;
+}
+
+void arena_reset(bump_arena *a) {
+    for (arena_chunk *c = a->chunks; c; c = c->next) {
+        c->used = 0;
+    }
+    a->head = a->chunks;
+}
+
+void arena_destroy(bump_arena *a) {
+    arena_chunk *c = a->chunks;
+    while (c) {
+        arena_chunk *next = c->next;
+        free(c);
+        c = next;
+    }
+    a->head = a->chunks = NULL;
+}
+
+// memcpy into a register compiles to a single (possibly unaligned) load
+// and keeps the XOR/OR accumulation free of data-dependent branches.
+static inline uint64_t load_u64(const unsigned char *p) {
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+int constant_time_cmp(const unsigned char *a, const unsigned char *b, size_t len) {
+    uint64_t diff = 0;
+    size_t i = 0;
+    for (; i + 8 <= len; i += 8) {
+        diff |= load_u64(a + i) ^ load_u64(b + i);
+    }
+    for (; i < len; ++i) {
+        diff |= (uint64_t)(a[i] ^ b[i]);
+    }
+    return diff == 0;
+}
+
+int constant_time_cmp32(const unsigned char *a, const unsigned char *b) {
+    uint64_t diff = (load_u64(a) ^ load_u64(b)) |
+                    (load_u64(a + 8) ^ load_u64(b + 8)) |
+                    (load_u64(a + 16) ^ load_u64(b + 16)) |
+                    (load_u64(a + 24) ^ load_u64(b + 24));
+    return diff == 0;
+}
+
+int hmac_engine_init(hmac_engine *e, const EVP_MD *md, const void *key,
+                     size_t key_len) {
+    e->tmpl = HMAC_CTX_new();
+    e->work = HMAC_CTX_new();
+    if (!e->tmpl || !e->work ||
+        !HMAC_Init_ex(e->tmpl, key, (int)key_len, md, NULL)) {
+        HMAC_CTX_free(e->tmpl);
+        HMAC_CTX_free(e->work);
+        e->tmpl = e->work = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+int hmac_engine_mac(hmac_engine *e, const unsigned char *msg, size_t msg_len,
+                    unsigned char *out, unsigned int *out_len) {
+    if (!HMAC_CTX_copy(e->work, e->tmpl) ||
+        !HMAC_Update(e->work, msg, msg_len) ||
+        !HMAC_Final(e->work, out, out_len)) {
+        return -1;
+    }
+    return 0;
+}
+
+int hmac_engine_clone(hmac_engine *dst, const hmac_engine *src) {
+    dst->tmpl = HMAC_CTX_new();
+    dst->work = HMAC_CTX_new();
+    if (!dst->tmpl || !dst->work || !HMAC_CTX_copy(dst->tmpl, src->tmpl)) {
+        HMAC_CTX_free(dst->tmpl);
+        HMAC_CTX_free(dst->work);
+        dst->tmpl = dst->work = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+void hmac_engine_free(hmac_engine *e) {
+    HMAC_CTX_free(e->tmpl);
+    HMAC_CTX_free(e->work);
+    e->tmpl = e->work = NULL;
+}
+
+// ---- multi-buffer HMAC-SHA1 ----
+//
+// HMAC over an 8-byte counter with a precomputed key schedule is two
+// single-block SHA-1 compressions. A TOTP window verify is 2w+1 such MACs
+// with the same key, so the lanes below batch four of them through one
+// SSE2 compression stream (IPsec-style multi-buffer hashing).
+
+static const uint32_t SHA1_H0[5] = {
+    0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0,
+};
+
+static inline uint32_t rotl32(uint32_t x, int n) {
+    return x << n | x >> (32 - n);
+}
+
+// One scalar SHA-1 compression over a 16-word big-endian block.
+static void sha1_compress(uint32_t state[5], const uint32_t block[16]) {
+    uint32_t w[80];
+    memcpy(w, block, 64);
+    for (int t = 16; t < 80; ++t) {
+        w[t] = rotl32(w[t - 3] ^ w[t - 8] ^ w[t - 14] ^ w[t - 16], 1);
+    }
+    uint32_t a = state[0], b = state[1], c = state[2], d = state[3], e = state[4];
+    for (int t = 0; t < 80; ++t) {
+        uint32_t f, k;
+        if (t < 20) {
+            f = (b & c) | (~b & d);
+            k = 0x5A827999;
+        } else if (t < 40) {
+            f = b ^ c ^ d;
+            k = 0x6ED9EBA1;
+        } else if (t < 60) {
+            f = (b & c) | (b & d) | (c & d);
+            k = 0x8F1BBCDC;
+        } else {
+            f = b ^ c ^ d;
+            k = 0xCA62C1D6;
+        }
+        uint32_t tmp = rotl32(a, 5) + f + e + k + w[t];
+        e = d;
+        d = c;
+        c = rotl32(b, 30);
+        b = a;
+        a = tmp;
+    }
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+    state[4] += e;
+}
+
+// Full scalar SHA-1, used to shorten over-long HMAC keys.
+static void sha1_hash(const unsigned char *data, size_t len, unsigned char out[20]) {
+    uint32_t state[5];
+    memcpy(state, SHA1_H0, sizeof(state));
+
+    uint32_t block[16];
+    size_t off = 0;
+    while (len - off >= 64) {
+        for (int i = 0; i < 16; ++i) {
+            const unsigned char *p = data + off + i * 4;
+            block[i] = (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 |
+                       (uint32_t)p[2] << 8 | p[3];
+        }
+        sha1_compress(state, block);
+        off += 64;
+    }
+
+    unsigned char tail[128] = {0};
+    size_t rem = len - off;
+    memcpy(tail, data + off, rem);
+    tail[rem] = 0x80;
+    size_t tail_len = rem + 9 <= 64 ? 64 : 128;
+    uint64_t bits = (uint64_t)len * 8;
+    for (int i = 0; i < 8; ++i) {
+        tail[tail_len - 1 - i] = (unsigned char)(bits >> (8 * i));
+    }
+    for (size_t o = 0; o < tail_len; o += 64) {
+        for (int i = 0; i < 16; ++i) {
+            const unsigned char *p = tail + o + i * 4;
+            block[i] = (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 |
+                       (uint32_t)p[2] << 8 | p[3];
+        }
+        sha1_compress(state, block);
+    }
+    for (int i = 0; i < 5; ++i) {
+        out[i * 4] = (unsigned char)(state[i] >> 24);
+        out[i * 4 + 1] = (unsigned char)(state[i] >> 16);
+        out[i * 4 + 2] = (unsigned char)(state[i] >> 8);
+        out[i * 4 + 3] = (unsigned char)state[i];
+    }
+}
+
+int hmac_sha1_padkey_init(hmac_sha1_padkey *k, const unsigned char *key,
+                          size_t key_len) {
+    unsigned char key_block[64] = {0};
+    unsigned char key_hash[20];
+    if (key_len > 64) {
+        sha1_hash(key, key_len, key_hash);
+        key = key_hash;
+        key_len = 20;
+    }
+    memcpy(key_block, key, key_len);
+
+    uint32_t block[16];
+    memcpy(k->istate, SHA1_H0, sizeof(k->istate));
+    for (int i = 0; i < 16; ++i) {
+        const unsigned char *p = key_block + i * 4;
+        block[i] = ((uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 |
+                    (uint32_t)p[2] << 8 | p[3]) ^ 0x36363636;
+    }
+    sha1_compress(k->istate, block);
+
+    memcpy(k->ostate, SHA1_H0, sizeof(k->ostate));
+    for (int i = 0; i < 16; ++i) {
+        block[i] ^= 0x36363636 ^ 0x5c5c5c5c;
+    }
+    sha1_compress(k->ostate, block);
+    return 0;
+}
+
+// ---- hardware SHA kernels ----
+//
+// Direct SHA-NI (x86) / ARMv8-CE kernels that skip the EVP provider
+// dispatch entirely: the block data never leaves registers between the
+// schedule and the round instructions. Availability is probed once at
+// first use; every caller keeps a portable fallback.
+
+static int sha_accel_probe(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    unsigned int eax, ebx, ecx, edx;
+    // SHA extensions: CPUID leaf 7, subleaf 0, EBX bit 29
+    if (__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx) && (ebx & (1u << 29))) {
+        return 1;
+    }
+    return 0;
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRYPTO)
+    unsigned long hwcap = getauxval(AT_HWCAP);
+    return (hwcap & (1ul << 5)) && (hwcap & (1ul << 6)); // SHA1 | SHA2
+#else
+    return 0;
+#endif
+}
+
+int authtools_sha_accel(void) {
+    // benign race: concurrent first calls all store the same answer
+    static int cached = -1;
+    if (cached < 0) cached = sha_accel_probe();
+    return cached;
+}
+
+#if defined(AUTHTOOLS_SHA_HW) && (defined(__x86_64__) || defined(__i386__))
+
+// SHA-NI single-block SHA-1 compression. The block holds host-order words
+// (big-endian values already assembled), so lanes only need word reversal,
+// not the byte shuffle the raw-data kernels use.
+AUTHTOOLS_SHA_TARGET
+static void sha1_compress_hw(uint32_t state[5], const uint32_t block[16]) {
+    AUTHTOOLS_SHA_CLEAN_UPPERS();
+    __m128i abcd = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)state),
+                                     0x1B);
+    __m128i e = _mm_set_epi32((int)state[4], 0, 0, 0);
+    const __m128i abcd_save = abcd, e_save = e;
+
+    __m128i m[4], prev = abcd;
+    for (int j = 0; j < 4; ++j) {
+        m[j] = _mm_shuffle_epi32(
+            _mm_loadu_si128((const __m128i *)(block + 4 * j)), 0x1B);
+    }
+    // 20 groups of 4 rounds; sha1rnds4 takes the round function as an
+    // immediate, hence the switch (constant-folded once unrolled).
+#pragma GCC unroll 20
+    for (int i = 0; i < 20; ++i) {
+        __m128i e_cur = i == 0 ? _mm_add_epi32(e, m[0])
+                               : _mm_sha1nexte_epu32(prev, m[i & 3]);
+        prev = abcd;
+        switch (i / 5) {
+        case 0: abcd = _mm_sha1rnds4_epu32(abcd, e_cur, 0); break;
+        case 1: abcd = _mm_sha1rnds4_epu32(abcd, e_cur, 1); break;
+        case 2: abcd = _mm_sha1rnds4_epu32(abcd, e_cur, 2); break;
+        default: abcd = _mm_sha1rnds4_epu32(abcd, e_cur, 3); break;
+        }
+        if (i >= 1 && i <= 16) {
+            m[(i - 1) & 3] = _mm_sha1msg1_epu32(m[(i - 1) & 3], m[i & 3]);
+        }
+        if (i >= 2 && i <= 17) {
+            m[(i - 2) & 3] = _mm_xor_si128(m[(i - 2) & 3], m[i & 3]);
+        }
+        if (i >= 3 && i <= 18) {
+            m[(i + 1) & 3] = _mm_sha1msg2_epu32(m[(i + 1) & 3], m[i & 3]);
+        }
+    }
+
+    e = _mm_sha1nexte_epu32(prev, e_save);
+    abcd = _mm_add_epi32(abcd, abcd_save);
+    abcd = _mm_shuffle_epi32(abcd, 0x1B);
+    _mm_storeu_si128((__m128i *)state, abcd);
+    state[4] = (uint32_t)_mm_extract_epi32(e, 3);
+}
+
+#elif defined(AUTHTOOLS_SHA_HW) // ARMv8-CE
+
+static void sha1_compress_hw(uint32_t state[5], const uint32_t block[16]) {
+    uint32x4_t abcd = vld1q_u32(state);
+    uint32_t e = state[4];
+    const uint32x4_t abcd_save = abcd;
+    const uint32_t e_save = e;
+    static const uint32_t K[4] = {
+        0x5A827999, 0x6ED9EBA1, 0x8F1BBCDC, 0xCA62C1D6,
+    };
+
+    uint32x4_t m[4];
+    for (int j = 0; j < 4; ++j) m[j] = vld1q_u32(block + 4 * j);
+
+    for (int i = 0; i < 20; ++i) {
+        uint32x4_t wk = vaddq_u32(m[i & 3], vdupq_n_u32(K[i / 5]));
+        uint32_t e_next = vsha1h_u32(vgetq_lane_u32(abcd, 0));
+        if (i < 5) {
+            abcd = vsha1cq_u32(abcd, e, wk);
+        } else if (i < 10 || i >= 15) {
+            abcd = vsha1pq_u32(abcd, e, wk);
+        } else {
+            abcd = vsha1mq_u32(abcd, e, wk);
+        }
+        e = e_next;
+        if (i < 16) {
+            m[i & 3] = vsha1su1q_u32(
+                vsha1su0q_u32(m[i & 3], m[(i + 1) & 3], m[(i + 2) & 3]),
+                m[(i + 3) & 3]);
+        }
+    }
+
+    vst1q_u32(state, vaddq_u32(abcd, abcd_save));
+    state[4] = e + e_save;
+}
+
+#endif // AUTHTOOLS_SHA_HW sha1
+
+// ---- SHA-256 / HMAC-SHA256 direct path ----
+
+static const uint32_t SHA256_H0[8] = {
+    0x6A09E667, 0xBB67AE85, 0x3C6EF372, 0xA54FF53A,
+    0x510E527F, 0x9B05688C, 0x1F83D9AB, 0x5BE0CD19,
+};
+
+static const uint32_t K256[64] = {
+    0x428A2F98, 0x71374491, 0xB5C0FBCF, 0xE9B5DBA5,
+    0x3956C25B, 0x59F111F1, 0x923F82A4, 0xAB1C5ED5,
+    0xD807AA98, 0x12835B01, 0x243185BE, 0x550C7DC3,
+    0x72BE5D74, 0x80DEB1FE, 0x9BDC06A7, 0xC19BF174,
+    0xE49B69C1, 0xEFBE4786, 0x0FC19DC6, 0x240CA1CC,
+    0x2DE92C6F, 0x4A7484AA, 0x5CB0A9DC, 0x76F988DA,
+    0x983E5152, 0xA831C66D, 0xB00327C8, 0xBF597FC7,
+    0xC6E00BF3, 0xD5A79147, 0x06CA6351, 0x14292967,
+    0x27B70A85, 0x2E1B2138, 0x4D2C6DFC, 0x53380D13,
+    0x650A7354, 0x766A0ABB, 0x81C2C92E, 0x92722C85,
+    0xA2BFE8A1, 0xA81A664B, 0xC24B8B70, 0xC76C51A3,
+    0xD192E819, 0xD6990624, 0xF40E3585, 0x106AA070,
+    0x19A4C116, 0x1E376C08, 0x2748774C, 0x34B0BCB5,
+    0x391C0CB3, 0x4ED8AA4A, 0x5B9CCA4F, 0x682E6FF3,
+    0x748F82EE, 0x78A5636F, 0x84C87814, 0x8CC70208,
+    0x90BEFFFA, 0xA4506CEB, 0xBEF9A3F7, 0xC67178F2,
+};
+
+// One scalar SHA-256 compression over a 16-word big-endian block.
+static void sha256_compress(uint32_t state[8], const uint32_t block[16]) {
+    uint32_t w[64];
+    memcpy(w, block, 64);
+    for (int t = 16; t < 64; ++t) {
+        uint32_t s0 = rotl32(w[t - 15], 25) ^ rotl32(w[t - 15], 14) ^
+                      (w[t - 15] >> 3);
+        uint32_t s1 = rotl32(w[t - 2], 15) ^ rotl32(w[t - 2], 13) ^
+                      (w[t - 2] >> 10);
+        w[t] = w[t - 16] + s0 + w[t - 7] + s1;
+    }
+    uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+    uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+    for (int t = 0; t < 64; ++t) {
+        uint32_t s1 = rotl32(e, 26) ^ rotl32(e, 21) ^ rotl32(e, 7);
+        uint32_t ch = (e & f) ^ (~e & g);
+        uint32_t t1 = h + s1 + ch + K256[t] + w[t];
+        uint32_t s0 = rotl32(a, 30) ^ rotl32(a, 19) ^ rotl32(a, 10);
+        uint32_t maj = (a & b) ^ (a & c) ^ (b & c);
+        uint32_t t2 = s0 + maj;
+        h = g;
+        g = f;
+        f = e;
+        e = d + t1;
+        d = c;
+        c = b;
+        b = a;
+        a = t1 + t2;
+    }
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+    state[4] += e;
+    state[5] += f;
+    state[6] += g;
+    state[7] += h;
+}
+
+#if defined(AUTHTOOLS_SHA_HW) && (defined(__x86_64__) || defined(__i386__))
+
+// SHA-NI single-block SHA-256 compression over host-order words.
+AUTHTOOLS_SHA_TARGET
+static void sha256_compress_hw(uint32_t state[8], const uint32_t block[16]) {
+    AUTHTOOLS_SHA_CLEAN_UPPERS();
+    __m128i tmp = _mm_loadu_si128((const __m128i *)&state[0]);
+    __m128i st1 = _mm_loadu_si128((const __m128i *)&state[4]);
+    tmp = _mm_shuffle_epi32(tmp, 0xB1);       // CDAB
+    st1 = _mm_shuffle_epi32(st1, 0x1B);       // EFGH
+    __m128i st0 = _mm_alignr_epi8(tmp, st1, 8);     // ABEF
+    st1 = _mm_blend_epi16(st1, tmp, 0xF0);          // CDGH
+    const __m128i abef_save = st0, cdgh_save = st1;
+
+    __m128i m[4];
+    for (int j = 0; j < 4; ++j) {
+        m[j] = _mm_loadu_si128((const __m128i *)(block + 4 * j));
+    }
+#pragma GCC unroll 16
+    for (int i = 0; i < 16; ++i) {
+        __m128i wk = _mm_add_epi32(
+            m[i & 3], _mm_loadu_si128((const __m128i *)&K256[4 * i]));
+        st1 = _mm_sha256rnds2_epu32(st1, st0, wk);
+        if (i >= 3 && i < 15) {
+            __m128i t = _mm_alignr_epi8(m[i & 3], m[(i + 3) & 3], 4);
+            m[(i + 1) & 3] = _mm_sha256msg2_epu32(
+                _mm_add_epi32(m[(i + 1) & 3], t), m[i & 3]);
+        }
+        wk = _mm_shuffle_epi32(wk, 0x0E);
+        st0 = _mm_sha256rnds2_epu32(st0, st1, wk);
+        if (i >= 1 && i < 14) {
+            m[(i - 1) & 3] = _mm_sha256msg1_epu32(m[(i - 1) & 3], m[i & 3]);
+        }
+    }
+
+    st0 = _mm_add_epi32(st0, abef_save);
+    st1 = _mm_add_epi32(st1, cdgh_save);
+    tmp = _mm_shuffle_epi32(st0, 0x1B);       // FEBA
+    st1 = _mm_shuffle_epi32(st1, 0xB1);       // DCHG
+    st0 = _mm_blend_epi16(tmp, st1, 0xF0);    // DCBA
+    st1 = _mm_alignr_epi8(st1, tmp, 8);       // HGFE
+    _mm_storeu_si128((__m128i *)&state[0], st0);
+    _mm_storeu_si128((__m128i *)&state[4], st1);
+}
+
+#elif defined(AUTHTOOLS_SHA_HW) // ARMv8-CE
+
+static void sha256_compress_hw(uint32_t state[8], const uint32_t block[16]) {
+    uint32x4_t st0 = vld1q_u32(&state[0]);
+    uint32x4_t st1 = vld1q_u32(&state[4]);
+    const uint32x4_t s0_save = st0, s1_save = st1;
+
+    uint32x4_t m[4];
+    for (int j = 0; j < 4; ++j) m[j] = vld1q_u32(block + 4 * j);
+
+    for (int i = 0; i < 16; ++i) {
+        uint32x4_t wk = vaddq_u32(m[i & 3], vld1q_u32(&K256[4 * i]));
+        uint32x4_t t0 = st0;
+        st0 = vsha256hq_u32(st0, st1, wk);
+        st1 = vsha256h2q_u32(st1, t0, wk);
+        if (i < 12) {
+            m[i & 3] = vsha256su1q_u32(
+                vsha256su0q_u32(m[i & 3], m[(i + 1) & 3]),
+                m[(i + 2) & 3], m[(i + 3) & 3]);
+        }
+    }
+
+    vst1q_u32(&state[0], vaddq_u32(st0, s0_save));
+    vst1q_u32(&state[4], vaddq_u32(st1, s1_save));
+}
+
+#endif // AUTHTOOLS_SHA_HW sha256
+
+// One compression with the best available kernel.
+static void sha256_compress_best(uint32_t state[8], const uint32_t block[16]) {
+#ifdef AUTHTOOLS_SHA_HW
+    if (authtools_sha_accel()) {
+        sha256_compress_hw(state, block);
+        return;
+    }
+#endif
+    sha256_compress(state, block);
+}
+
+static inline void be_block_load(uint32_t block[16], const unsigned char *p) {
+    for (int i = 0; i < 16; ++i) {
+        block[i] = (uint32_t)p[i * 4] << 24 | (uint32_t)p[i * 4 + 1] << 16 |
+                   (uint32_t)p[i * 4 + 2] << 8 | p[i * 4 + 3];
+    }
+}
+
+// Full scalar SHA-256, used to shorten over-long HMAC keys.
+static void sha256_hash(const unsigned char *data, size_t len,
+                        unsigned char out[32]) {
+    uint32_t state[8];
+    memcpy(state, SHA256_H0, sizeof(state));
+
+    uint32_t block[16];
+    size_t off = 0;
+    while (len - off >= 64) {
+        be_block_load(block, data + off);
+        sha256_compress(state, block);
+        off += 64;
+    }
+
+    unsigned char tail[128] = {0};
+    size_t rem = len - off;
+    memcpy(tail, data + off, rem);
+    tail[rem] = 0x80;
+    size_t tail_len = rem + 9 <= 64 ? 64 : 128;
+    uint64_t bits = (uint64_t)len * 8;
+    for (int i = 0; i < 8; ++i) {
+        tail[tail_len - 1 - i] = (unsigned char)(bits >> (8 * i));
+    }
+    for (size_t o = 0; o < tail_len; o += 64) {
+        be_block_load(block, tail + o);
+        sha256_compress(state, block);
+    }
+    for (int i = 0; i < 8; ++i) {
+        out[i * 4] = (unsigned char)(state[i] >> 24);
+        out[i * 4 + 1] = (unsigned char)(state[i] >> 16);
+        out[i * 4 + 2] = (unsigned char)(state[i] >> 8);
+        out[i * 4 + 3] = (unsigned char)state[i];
+    }
+}
+
+int hmac_sha256_padkey_init(hmac_sha256_padkey *k, const unsigned char *key,
+                            size_t key_len) {
+    unsigned char key_block[64] = {0};
+    unsigned char key_hash[32];
+    if (key_len > 64) {
+        sha256_hash(key, key_len, key_hash);
+        key = key_hash;
+        key_len = 32;
+    }
+    memcpy(key_block, key, key_len);
+
+    uint32_t block[16];
+    memcpy(k->istate, SHA256_H0, sizeof(k->istate));
+    for (int i = 0; i < 16; ++i) {
+        const unsigned char *p = key_block + i * 4;
+        block[i] = ((uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 |
+                    (uint32_t)p[2] << 8 | p[3]) ^ 0x36363636;
+    }
+    sha256_compress(k->istate, block);
+
+    memcpy(k->ostate, SHA256_H0, sizeof(k->ostate));
+    for (int i = 0; i < 16; ++i) {
+        block[i] ^= 0x36363636 ^ 0x5c5c5c5c;
+    }
+    sha256_compress(k->ostate, block);
+    return 0;
+}
+
+void hmac_sha256_mac(const hmac_sha256_padkey *k, const unsigned char *msg,
+                     size_t msg_len, unsigned char out[32]) {
+    uint32_t state[8];
+    memcpy(state, k->istate, sizeof(state));
+
+    uint32_t block[16];
+    size_t off = 0;
+    while (msg_len - off >= 64) {
+        be_block_load(block, msg + off);
+        sha256_compress_best(state, block);
+        off += 64;
+    }
+    // total hashed length includes the already-compressed ipad block
+    unsigned char tail[128] = {0};
+    size_t rem = msg_len - off;
+    memcpy(tail, msg + off, rem);
+    tail[rem] = 0x80;
+    size_t tail_len = rem + 9 <= 64 ? 64 : 128;
+    uint64_t bits = (64 + (uint64_t)msg_len) * 8;
+    for (int i = 0; i < 8; ++i) {
+        tail[tail_len - 1 - i] = (unsigned char)(bits >> (8 * i));
+    }
+    for (size_t o = 0; o < tail_len; o += 64) {
+        be_block_load(block, tail + o);
+        sha256_compress_best(state, block);
+    }
+
+    // outer block: 32-byte inner digest, pad, length (64+32)*8 = 768 bits
+    uint32_t oblock[16] = {0};
+    memcpy(oblock, state, 32);
+    oblock[8] = 0x80000000;
+    oblock[15] = 768;
+    memcpy(state, k->ostate, sizeof(state));
+    sha256_compress_best(state, oblock);
+
+    for (int i = 0; i < 8; ++i) {
+        out[i * 4] = (unsigned char)(state[i] >> 24);
+        out[i * 4 + 1] = (unsigned char)(state[i] >> 16);
+        out[i * 4 + 2] = (unsigned char)(state[i] >> 8);
+        out[i * 4 + 3] = (unsigned char)state[i];
+    }
+}
+
+// One compression with the best available kernel.
+static void sha1_compress_best(uint32_t state[5], const uint32_t block[16]) {
+#ifdef AUTHTOOLS_SHA_HW
+    if (authtools_sha_accel()) {
+        sha1_compress_hw(state, block);
+        return;
+    }
+#endif
+    sha1_compress(state, block);
+}
+
+void hmac_sha1_counter1(const hmac_sha1_padkey *k, uint64_t step,
+                        unsigned char out[20]) {
+    uint32_t block[16] = {0};
+    block[0] = (uint32_t)(step >> 32);
+    block[1] = (uint32_t)step;
+    block[2] = 0x80000000;
+    block[15] = 576;
+    uint32_t st[5];
+    memcpy(st, k->istate, sizeof(st));
+    sha1_compress_best(st, block);
+
+    uint32_t oblock[16] = {0};
+    memcpy(oblock, st, 20);
+    oblock[5] = 0x80000000;
+    oblock[15] = 672;
+    memcpy(st, k->ostate, sizeof(st));
+    sha1_compress_best(st, oblock);
+    for (int i = 0; i < 5; ++i) {
+        out[i * 4] = (unsigned char)(st[i] >> 24);
+        out[i * 4 + 1] = (unsigned char)(st[i] >> 16);
+        out[i * 4 + 2] = (unsigned char)(st[i] >> 8);
+        out[i * 4 + 3] = (unsigned char)st[i];
+    }
+}
+
+#if defined(AUTHTOOLS_SHA_HW) && !defined(__SSE2__)
+
+// Hardware variant of hmac_sha1_counter4 for targets without the 4-lane
+// SSE2 stream (ARMv8-CE): four independent compress pairs.
+static void sha1_counter4_hw(const hmac_sha1_padkey *k, const uint64_t steps[4],
+                             unsigned char out[4][20]) {
+    for (int l = 0; l < 4; ++l) {
+        uint32_t block[16] = {0};
+        block[0] = (uint32_t)(steps[l] >> 32);
+        block[1] = (uint32_t)steps[l];
+        block[2] = 0x80000000;
+        block[15] = 576;
+        uint32_t st[5];
+        memcpy(st, k->istate, sizeof(st));
+        sha1_compress_hw(st, block);
+
+        uint32_t oblock[16] = {0};
+        memcpy(oblock, st, 20);
+        oblock[5] = 0x80000000;
+        oblock[15] = 672;
+        memcpy(st, k->ostate, sizeof(st));
+        sha1_compress_hw(st, oblock);
+        for (int i = 0; i < 5; ++i) {
+            out[l][i * 4] = (unsigned char)(st[i] >> 24);
+            out[l][i * 4 + 1] = (unsigned char)(st[i] >> 16);
+            out[l][i * 4 + 2] = (unsigned char)(st[i] >> 8);
+            out[l][i * 4 + 3] = (unsigned char)st[i];
+        }
+    }
+}
+
+#endif // AUTHTOOLS_SHA_HW && !__SSE2__
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+
+static inline __m128i rotl_epi32(__m128i x, int n) {
+    return _mm_or_si128(_mm_slli_epi32(x, n), _mm_srli_epi32(x, 32 - n));
+}
+
+// 4-lane SHA-1 compression: element i of each state vector is lane i's
+// state word; blocks[lane] holds that lane's 16 big-endian message words.
+static void sha1_compress_x4(__m128i st[5], const uint32_t blocks[4][16]) {
+    __m128i w[80];
+    for (int t = 0; t < 16; ++t) {
+        w[t] = _mm_set_epi32((int)blocks[3][t], (int)blocks[2][t],
+                             (int)blocks[1][t], (int)blocks[0][t]);
+    }
+    for (int t = 16; t < 80; ++t) {
+        w[t] = rotl_epi32(_mm_xor_si128(_mm_xor_si128(w[t - 3], w[t - 8]),
+                                        _mm_xor_si128(w[t - 14], w[t - 16])), 1);
+    }
+    __m128i a = st[0], b = st[1], c = st[2], d = st[3], e = st[4];
+    for (int t = 0; t < 80; ++t) {
+        __m128i f, k;
+        if (t < 20) {
+            f = _mm_or_si128(_mm_and_si128(b, c), _mm_andnot_si128(b, d));
+            k = _mm_set1_epi32(0x5A827999);
+        } else if (t < 40) {
+            f = _mm_xor_si128(_mm_xor_si128(b, c), d);
+            k = _mm_set1_epi32(0x6ED9EBA1);
+        } else if (t < 60) {
+            f = _mm_or_si128(_mm_or_si128(_mm_and_si128(b, c), _mm_and_si128(b, d)),
+                             _mm_and_si128(c, d));
+            k = _mm_set1_epi32((int)0x8F1BBCDC);
+        } else {
+            f = _mm_xor_si128(_mm_xor_si128(b, c), d);
+            k = _mm_set1_epi32((int)0xCA62C1D6);
+        }
+        __m128i tmp = _mm_add_epi32(_mm_add_epi32(rotl_epi32(a, 5), f),
+                                    _mm_add_epi32(_mm_add_epi32(e, k), w[t]));
+        e = d;
+        d = c;
+        c = rotl_epi32(b, 30);
+        b = a;
+        a = tmp;
+    }
+    st[0] = _mm_add_epi32(st[0], a);
+    st[1] = _mm_add_epi32(st[1], b);
+    st[2] = _mm_add_epi32(st[2], c);
+    st[3] = _mm_add_epi32(st[3], d);
+    st[4] = _mm_add_epi32(st[4], e);
+}
+
+void hmac_sha1_counter4(const hmac_sha1_padkey *k, const uint64_t steps[4],
+                        unsigned char out[4][20]) {
+    // Even with SHA-NI present the 4-lane SSE2 stream wins here: eight
+    // serial hardware compressions sit on the SHA1RNDS4 latency chain,
+    // while the multi-buffer form keeps all four lanes in flight.
+    // inner blocks: 8-byte counter, 0x80 pad, length (64+8)*8 = 576 bits
+    uint32_t blocks[4][16] = {{0}};
+    for (int l = 0; l < 4; ++l) {
+        blocks[l][0] = (uint32_t)(steps[l] >> 32);
+        blocks[l][1] = (uint32_t)steps[l];
+        blocks[l][2] = 0x80000000;
+        blocks[l][15] = 576;
+    }
+    __m128i st[5];
+    for (int i = 0; i < 5; ++i) {
+        st[i] = _mm_set1_epi32((int)k->istate[i]);
+    }
+    sha1_compress_x4(st, blocks);
+
+    // outer blocks: 20-byte inner digest, pad, length (64+20)*8 = 672 bits
+    uint32_t inner[5][4]; // [word][lane]
+    for (int i = 0; i < 5; ++i) {
+        _mm_storeu_si128((__m128i *)inner[i], st[i]);
+    }
+    memset(blocks, 0, sizeof(blocks));
+    for (int l = 0; l < 4; ++l) {
+        for (int i = 0; i < 5; ++i) {
+            blocks[l][i] = inner[i][l];
+        }
+        blocks[l][5] = 0x80000000;
+        blocks[l][15] = 672;
+    }
+    for (int i = 0; i < 5; ++i) {
+        st[i] = _mm_set1_epi32((int)k->ostate[i]);
+    }
+    sha1_compress_x4(st, blocks);
+
+    uint32_t final[5][4];
+    for (int i = 0; i < 5; ++i) {
+        _mm_storeu_si128((__m128i *)final[i], st[i]);
+    }
+    for (int l = 0; l < 4; ++l) {
+        for (int i = 0; i < 5; ++i) {
+            uint32_t v = final[i][l];
+            out[l][i * 4] = (unsigned char)(v >> 24);
+            out[l][i * 4 + 1] = (unsigned char)(v >> 16);
+            out[l][i * 4 + 2] = (unsigned char)(v >> 8);
+            out[l][i * 4 + 3] = (unsigned char)v;
+        }
+    }
+}
+
+void hmac_sha1_key4(const hmac_sha1_padkey *const keys[4], uint64_t step,
+                    unsigned char out[4][20]) {
+    // same inner/outer block shape as hmac_sha1_counter4, but the lanes
+    // carry four different key schedules over one shared counter message
+    uint32_t blocks[4][16] = {{0}};
+    for (int l = 0; l < 4; ++l) {
+        blocks[l][0] = (uint32_t)(step >> 32);
+        blocks[l][1] = (uint32_t)step;
+        blocks[l][2] = 0x80000000;
+        blocks[l][15] = 576;
+    }
+    __m128i st[5];
+    for (int i = 0; i < 5; ++i) {
+        st[i] = _mm_set_epi32((int)keys[3]->istate[i], (int)keys[2]->istate[i],
+                              (int)keys[1]->istate[i], (int)keys[0]->istate[i]);
+    }
+    sha1_compress_x4(st, blocks);
+
+    uint32_t inner[5][4]; // [word][lane]
+    for (int i = 0; i < 5; ++i) {
+        _mm_storeu_si128((__m128i *)inner[i], st[i]);
+    }
+    memset(blocks, 0, sizeof(blocks));
+    for (int l = 0; l < 4; ++l) {
+        for (int i = 0; i < 5; ++i) {
+            blocks[l][i] = inner[i][l];
+        }
+        blocks[l][5] = 0x80000000;
+        blocks[l][15] = 672;
+    }
+    for (int i = 0; i < 5; ++i) {
+        st[i] = _mm_set_epi32((int)keys[3]->ostate[i], (int)keys[2]->ostate[i],
+                              (int)keys[1]->ostate[i], (int)keys[0]->ostate[i]);
+    }
+    sha1_compress_x4(st, blocks);
+
+    uint32_t final[5][4];
+    for (int i = 0; i < 5; ++i) {
+        _mm_storeu_si128((__m128i *)final[i], st[i]);
+    }
+    for (int l = 0; l < 4; ++l) {
+        for (int i = 0; i < 5; ++i) {
+            uint32_t v = final[i][l];
+            out[l][i * 4] = (unsigned char)(v >> 24);
+            out[l][i * 4 + 1] = (unsigned char)(v >> 16);
+            out[l][i * 4 + 2] = (unsigned char)(v >> 8);
+            out[l][i * 4 + 3] = (unsigned char)v;
+        }
+    }
+}
+
+#else // !__SSE2__
+
+void hmac_sha1_counter4(const hmac_sha1_padkey *k, const uint64_t steps[4],
+                        unsigned char out[4][20]) {
+#ifdef AUTHTOOLS_SHA_HW
+    if (authtools_sha_accel()) {
+        sha1_counter4_hw(k, steps, out);
+        return;
+    }
+#endif
+    for (int l = 0; l < 4; ++l) {
+        uint32_t block[16] = {0};
+        block[0] = (uint32_t)(steps[l] >> 32);
+        block[1] = (uint32_t)steps[l];
+        block[2] = 0x80000000;
+        block[15] = 576;
+        uint32_t st[5];
+        memcpy(st, k->istate, sizeof(st));
+        sha1_compress(st, block);
+
+        uint32_t oblock[16] = {0};
+        memcpy(oblock, st, 20);
+        oblock[5] = 0x80000000;
+        oblock[15] = 672;
+        memcpy(st, k->ostate, sizeof(st));
+        sha1_compress(st, oblock);
+        for (int i = 0; i < 5; ++i) {
+            out[l][i * 4] = (unsigned char)(st[i] >> 24);
+            out[l][i * 4 + 1] = (unsigned char)(st[i] >> 16);
+            out[l][i * 4 + 2] = (unsigned char)(st[i] >> 8);
+            out[l][i * 4 + 3] = (unsigned char)st[i];
+        }
+    }
+}
+
+void hmac_sha1_key4(const hmac_sha1_padkey *const keys[4], uint64_t step,
+                    unsigned char out[4][20]) {
+    // no 4-lane kernel: one serial MAC per key, hardware when available
+    for (int l = 0; l < 4; ++l) {
+        hmac_sha1_counter1(keys[l], step, out[l]);
+    }
+}
+
+#endif // __SSE2__
+
+// ---- cycle accounting (--stats) ----
+
+void stat_report(const char *const names[], const stat_counter *acc,
+                 int nstages) {
+    fprintf(stderr, "%-16s %12s %12s %12s\n", "stage", "ops", "cycles/op",
+            "bytes/cycle");
+    for (int s = 0; s < nstages; ++s) {
+        const stat_counter *c = &acc[s];
+        fprintf(stderr, "%-16s %12llu %12.1f %12.3f\n", names[s],
+                (unsigned long long)c->ops,
+                c->ops ? (double)c->cycles / (double)c->ops : 0.0,
+                c->cycles ? (double)c->bytes / (double)c->cycles : 0.0);
+    }
+}
+
+// ---- shared metrics segment ----
+
+const char *const metrics_stage_names[METRICS_STAGES] = {
+    "decode", "mac", "compare", "output",
+};
+
+metrics_segment *metrics_map(const char *name, int create) {
+    int flags = create ? O_RDWR | O_CREAT : O_RDWR;
+    int fd = shm_open(name, flags, 0644);
+    if (fd < 0) return NULL;
+    if (create && ftruncate(fd, sizeof(metrics_segment)) != 0) {
+        close(fd);
+        return NULL;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(metrics_segment)) {
+        close(fd);
+        return NULL;
+    }
+    metrics_segment *m = mmap(NULL, sizeof(metrics_segment),
+                              PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (m == MAP_FAILED) return NULL;
+    if (create) {
+        // counters survive reopens; only stamp a fresh segment
+        uint64_t expect = 0;
+        __atomic_compare_exchange_n(&m->magic, &expect, METRICS_MAGIC, 0,
+                                    __ATOMIC_RELEASE, __ATOMIC_RELAXED);
+    }
+    if (__atomic_load_n(&m->magic, __ATOMIC_ACQUIRE) != METRICS_MAGIC) {
+        munmap(m, sizeof(metrics_segment));
+        return NULL;
+    }
+    return m;
+}
+
+// Compile-time powers of ten: totp_pow10[d] bounds a d-digit code. Kills
+// the pow() libm round-trip the modulus used to take.
+const uint32_t totp_pow10[10] = {
+    1, 10, 100, 1000, 10000, 100000,
+    1000000, 10000000, 100000000, 1000000000,
+};
+
+void totp_format_code(uint32_t code, size_t digits, char *out) {
+    // fixed width, emitted last digit first: one multiply-and-shift
+    // reciprocal per digit, no format-string parse, no data-dependent
+    // branches
+    out[digits] = '\0';
+    for (size_t i = digits; i-- > 0;) {
+        out[i] = (char)('0' + code % 10);
+        code /= 10;
+    }
+}
+
+int totp_parse_code(const char *code, size_t digits, uint32_t *out) {
+    uint32_t v = 0;
+    size_t i;
+    for (i = 0; code[i]; ++i) {
+        if (i == digits || code[i] < '0' || code[i] > '9') return -1;
+        v = v * 10 + (uint32_t)(code[i] - '0');
+    }
+    if (i != digits) return -1;
+    *out = v;
+    return 0;
+}
+
+uint32_t totp_truncate(const unsigned char *hmac_result) {
+    int offset = hmac_result[19] & 0x0f;
+    uint32_t bin_code = (hmac_result[offset] & 0x7f) << 24 |
+                        (hmac_result[offset + 1] & 0xff) << 16 |
+                        (hmac_result[offset + 2] & 0xff) << 8 |
+                        (hmac_result[offset + 3] & 0xff);
+    return bin_code;
+}
+
+int totp_code_at(hmac_engine *eng, uint64_t timestep, size_t digits,
+                 char *out_code) {
+    unsigned char msg[8];
+    uint64_t t = timestep;
+    for (int j = 7; j >= 0; --j) {
+        msg[j] = t & 0xFF;
+        t >>= 8;
+    }
+    unsigned char hmac_result[EVP_MAX_MD_SIZE];
+    unsigned int len = 0;
+    if (hmac_engine_mac(eng, msg, sizeof(msg), hmac_result, &len) != 0) {
+        return -1;
+    }
+    uint32_t otp = totp_truncate(hmac_result) % totp_pow10[digits];
+    totp_format_code(otp, digits, out_code);
+    return 0;
+}
+
+void compute_totp(const char *base32_secret, int window, char *out_code,
+                  size_t digits) {
+    unsigned char secret_bytes[128];
+    size_t secret_len = 0;
+    if (base32_decode_buf(base32_secret, secret_bytes, sizeof(secret_bytes),
+                          &secret_len) != 0) {
+        fprintf(stderr, "Failed to decode base32 secret\n");
+        exit(1);
+    }
+
+    hmac_engine eng;
+    if (hmac_engine_init(&eng, EVP_sha1(), secret_bytes, secret_len) != 0) {
+        fprintf(stderr, "HMAC init failed\n");
+        exit(1);
+    }
+
+    uint64_t timestep = (uint64_t)(time(NULL) / 30);
+    (void)window; // generation always emits the current step's code
+    totp_code_at(&eng, timestep, digits, out_code);
+
+    hmac_engine_free(&eng);
+}
+
+int verify_totp(const char *secret, const char *code, int window) {
+    unsigned char secret_bytes[128];
+    size_t secret_len = 0;
+    if (base32_decode_buf(secret, secret_bytes, sizeof(secret_bytes),
+                          &secret_len) != 0) {
+        return 0;
+    }
+
+    hmac_sha1_padkey key;
+    hmac_sha1_padkey_init(&key, secret_bytes, secret_len);
+
+    // run the 2w+1 candidate timesteps through the 4-lane kernel; unused
+    // lanes in the last batch just recompute the first step
+    uint32_t code_val;
+    if (totp_parse_code(code, 6, &code_val) != 0) return 0;
+
+    uint64_t timestep = (uint64_t)(time(NULL) / 30);
+    int total = 2 * window + 1;
+    int ok = 0;
+    for (int base = 0; base < total && !ok; base += 4) {
+        uint64_t steps[4];
+        for (int l = 0; l < 4; ++l) {
+            int i = base + l < total ? base + l : 0;
+            steps[l] = timestep - window + i;
+        }
+        unsigned char digests[4][20];
+        hmac_sha1_counter4(&key, steps, digests);
+        int lanes = total - base < 4 ? total - base : 4;
+        for (int l = 0; l < lanes && !ok; ++l) {
+            if (totp_truncate(digests[l]) % 1000000 == code_val) ok = 1;
+        }
+    }
+    return ok;
+}
@@ -0,0 +1,295 @@
+// libauthtools: core verification primitives shared by the native tools
+// and linkable from other runtimes over plain C FFI.
+//
+// Build with: make tools-lib (produces tools/libauthtools.a and .so)
+//
+// Everything here is allocation-free on the hot path: decoders write into
+// caller-provided buffers and the HMAC engine precomputes the padded key
+// state once per secret, cloning it per message.
+
+#ifndef AUTHTOOLS_H
+#define AUTHTOOLS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+#include <openssl/hmac.h>
+#include <openssl/evp.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// ---- encoding ----
+
+// Decode a base64url slice (padded or unpadded) straight into a caller
+// buffer with no intermediate copies. Returns 0 on success, -1 on invalid
+// input or insufficient output space.
+int b64url_decode_buf(const char *input, size_t in_len, unsigned char *out,
+                      size_t out_cap, size_t *out_len);
+
+// Decode a base32 secret into a caller-supplied buffer: one table load per
+// input byte, case-insensitive, invalid bytes skipped, '='/' ' terminating.
+// Returns 0 on success, -1 if the output buffer is too small.
+int base32_decode_buf(const char *encoded, unsigned char *out, size_t out_cap,
+                      size_t *out_len);
+
+// Convenience malloc-based wrapper around base32_decode_buf.
+int base32_decode(const char *encoded, unsigned char **result, size_t *out_len);
+
+// ---- arena allocator ----
+
+// Chunked bump allocator for per-worker, per-batch state: allocations are
+// pointer bumps, reset rewinds every chunk in O(chunks), and nothing is
+// freed individually - no malloc/free pair per token and no heap lock
+// contention across worker threads.
+typedef struct arena_chunk arena_chunk;
+
+typedef struct {
+    arena_chunk *head;    // chunk currently bumped into
+    arena_chunk *chunks;  // all chunks, for reset/destroy
+    size_t chunk_size;
+} bump_arena;
+
+// chunk_size 0 picks a default (64 KiB).
+void arena_init(bump_arena *a, size_t chunk_size);
+
+// 8-byte-aligned bump allocation; grows by whole chunks. NULL on OOM.
+void *arena_alloc(bump_arena *a, size_t size);
+
+// Rewind all chunks for reuse without returning memory to the heap.
+void arena_reset(bump_arena *a);
+
+void arena_destroy(bump_arena *a);
+
+// ---- comparison ----
+
+// Data-independent-timing comparison; returns 1 when equal. Processes
+// 8 bytes per iteration via 64-bit loads with a byte-wise tail.
+int constant_time_cmp(const unsigned char *a, const unsigned char *b, size_t len);
+
+// Fixed-size specialization for 32-byte MACs (HMAC-SHA256): four 64-bit
+// XOR/OR steps, fully unrolled, still data-independent.
+int constant_time_cmp32(const unsigned char *a, const unsigned char *b);
+
+// ---- HMAC engine ----
+
+// Keyed once per secret; the padded key state is precomputed and cloned
+// per message so each MAC costs only the compression calls.
+typedef struct {
+    HMAC_CTX *tmpl; // keyed once, holds the precomputed ipad/opad state
+    HMAC_CTX *work; // per-message clone target
+} hmac_engine;
+
+// Key the engine once. Returns 0 on success, -1 on failure.
+int hmac_engine_init(hmac_engine *e, const EVP_MD *md, const void *key,
+                     size_t key_len);
+
+// MAC one message by cloning the precomputed key state. Returns 0 on
+// success, -1 on failure.
+int hmac_engine_mac(hmac_engine *e, const unsigned char *msg, size_t msg_len,
+                    unsigned char *out, unsigned int *out_len);
+
+// Clone an engine for use on another thread, sharing the key schedule.
+int hmac_engine_clone(hmac_engine *dst, const hmac_engine *src);
+
+void hmac_engine_free(hmac_engine *e);
+
+// ---- multi-buffer HMAC-SHA1 ----
+
+// Precomputed HMAC-SHA1 pad states: the SHA-1 states after compressing
+// the ipad and opad blocks. Key setup happens once; each MAC over an
+// 8-byte counter message then costs exactly two compression calls.
+typedef struct {
+    uint32_t istate[5];
+    uint32_t ostate[5];
+} hmac_sha1_padkey;
+
+int hmac_sha1_padkey_init(hmac_sha1_padkey *k, const unsigned char *key,
+                          size_t key_len);
+
+// HMAC-SHA1 over four independent 8-byte big-endian counter messages
+// sharing one key - the shape of a TOTP window or bulk verify. On x86
+// this runs a 4-lane SSE2 SHA-1 kernel (two vector compressions for all
+// four MACs); elsewhere it falls back to four scalar compress pairs.
+void hmac_sha1_counter4(const hmac_sha1_padkey *k, const uint64_t steps[4],
+                        unsigned char out[4][20]);
+
+// HMAC-SHA1 of one shared 8-byte counter message under four independent
+// keys - the shape of bulk pregeneration, where every enrolled seed
+// needs the code for the same timestep. Runs the same 4-lane SSE2
+// kernel as hmac_sha1_counter4, with per-lane key state.
+void hmac_sha1_key4(const hmac_sha1_padkey *const keys[4], uint64_t step,
+                    unsigned char out[4][20]);
+
+// Serial single-counter HMAC-SHA1 for callers that need one MAC at a time
+// (code generation, the serve daemon): two compressions through the
+// hardware kernel when available, scalar otherwise.
+void hmac_sha1_counter1(const hmac_sha1_padkey *k, uint64_t step,
+                        unsigned char out[20]);
+
+// ---- hardware SHA dispatch / direct HMAC-SHA256 ----
+
+// 1 when the CPU has a hardware SHA unit (x86 SHA-NI or the ARMv8 crypto
+// extensions) usable by the direct kernels; probed once at first use.
+// When it returns 0 callers should stay on the EVP-backed hmac_engine.
+int authtools_sha_accel(void);
+
+// Precomputed HMAC-SHA256 pad states, mirroring hmac_sha1_padkey: the
+// SHA-256 states after compressing the ipad and opad blocks.
+typedef struct {
+    uint32_t istate[8];
+    uint32_t ostate[8];
+} hmac_sha256_padkey;
+
+int hmac_sha256_padkey_init(hmac_sha256_padkey *k, const unsigned char *key,
+                            size_t key_len);
+
+// HMAC-SHA256 over an arbitrary message through the direct kernels
+// (SHA-NI / ARMv8-CE when available, scalar otherwise), bypassing EVP
+// provider dispatch. Sized for short JWT signing inputs.
+void hmac_sha256_mac(const hmac_sha256_padkey *k, const unsigned char *msg,
+                     size_t msg_len, unsigned char out[32]);
+
+// ---- cycle accounting (--stats) ----
+
+// Per-stage accumulator for the tools' --stats breakdown: total cycles,
+// bytes processed and invocations for one pipeline stage on one worker.
+// Workers each own a padded array of these (no contention); the tool
+// merges and prints them on exit via stat_report.
+typedef struct {
+    uint64_t cycles;
+    uint64_t bytes;
+    uint64_t ops;
+} stat_counter;
+
+// Timestamp-counter read. On x86 this is rdtsc (cycles at base clock,
+// constant-rate on anything this decade); elsewhere it degrades to
+// CLOCK_MONOTONIC nanoseconds, so "cycles" in the report become ns.
+static inline uint64_t stat_cycles(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    return __builtin_ia32_rdtsc();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+// Instrumentation points compile to a single well-predicted NULL test
+// when --stats is off; acc is the worker's counter array (or NULL).
+static inline uint64_t stat_begin(const stat_counter *acc) {
+    return acc ? stat_cycles() : 0;
+}
+
+static inline void stat_end(stat_counter *acc, int stage, uint64_t t0,
+                            uint64_t nbytes) {
+    if (!acc) return;
+    acc[stage].cycles += stat_cycles() - t0;
+    acc[stage].bytes += nbytes;
+    acc[stage].ops += 1;
+}
+
+// Print a per-stage ops / cycles-per-op / bytes-per-cycle table for
+// already-merged counters to stderr (stdout carries verdict lines).
+void stat_report(const char *const names[], const stat_counter *acc,
+                 int nstages);
+
+// ---- shared metrics segment ----
+//
+// Fixed-layout POSIX shared-memory segment updated by the tools' hot
+// paths with relaxed atomic adds (no locks, no syscalls per event) and
+// scraped by the metrics_export sidecar as Prometheus text. Fields are
+// plain uint64_t manipulated through __atomic builtins so the layout
+// stays FFI- and C++-clean. Stage indices follow the --stats pipeline
+// order: decode, mac, compare, output.
+
+#define METRICS_MAGIC 0x736b746d78746d31ull
+#define METRICS_STAGES 4
+#define METRICS_BUCKETS 32 // log2(cycles) latency buckets per stage
+
+typedef struct {
+    uint64_t magic;
+    uint64_t verdicts[3]; // valid, invalid, malformed
+    uint64_t dedup_lookups;
+    uint64_t dedup_hits;
+    uint64_t stage_cycles[METRICS_STAGES];
+    uint64_t stage_ops[METRICS_STAGES];
+    uint64_t stage_hist[METRICS_STAGES][METRICS_BUCKETS];
+} metrics_segment;
+
+// Prometheus label values for the stage dimension, index-aligned with
+// the stage_* arrays.
+extern const char *const metrics_stage_names[METRICS_STAGES];
+
+// Map (and with create, initialize) the named segment, e.g.
+// "/authtools-jwt". Returns NULL on failure.
+metrics_segment *metrics_map(const char *name, int create);
+
+static inline void metrics_add(uint64_t *counter, uint64_t v) {
+    __atomic_fetch_add(counter, v, __ATOMIC_RELAXED);
+}
+
+// One stage observation: histogram bucket, cycle sum and op count -
+// three relaxed increments.
+static inline void metrics_stage_sample(metrics_segment *m, int stage,
+                                        uint64_t cycles) {
+    int b = cycles ? 63 - __builtin_clzll(cycles) : 0;
+    if (b >= METRICS_BUCKETS) b = METRICS_BUCKETS - 1;
+    metrics_add(&m->stage_hist[stage][b], 1);
+    metrics_add(&m->stage_cycles[stage], cycles);
+    metrics_add(&m->stage_ops[stage], 1);
+}
+
+// ---- binary verdict stream ----
+//
+// Fixed-width record format for jwt_verify --output-format binary: an
+// 8-byte magic followed by packed verdict_rec entries. Records carry
+// the global token index, so producers may emit them in any order;
+// verdict_read converts the stream back to text.
+
+#define VOUT_MAGIC 0x3176646a77767274ull // "trvwjdv1"
+
+typedef struct {
+    uint64_t index;  // global token index within the sweep
+    int64_t exp;     // exp claim of a valid token, -1 when absent
+    int32_t verdict; // 1 valid, 0 invalid, -1 malformed
+    uint32_t pad;
+} verdict_rec;
+
+// ---- TOTP (RFC 6238, HMAC-SHA1) ----
+
+// Powers of ten up to 10^9; totp_pow10[digits] is the code modulus.
+extern const uint32_t totp_pow10[10];
+
+// Fixed-width decimal formatting of a code into out (digits + 1 bytes):
+// no snprintf format parse, no data-dependent branches.
+void totp_format_code(uint32_t code, size_t digits, char *out);
+
+// Parse an exactly digits-long decimal code. Returns 0 and stores the
+// value, or -1 on wrong length / non-digits - so verification can
+// compare integers instead of formatted strings.
+int totp_parse_code(const char *code, size_t digits, uint32_t *out);
+
+// RFC 4226 dynamic truncation of a 20-byte HMAC-SHA1 result.
+uint32_t totp_truncate(const unsigned char *hmac_result);
+
+// Compute the code for one timestep through a pre-keyed HMAC-SHA1 engine
+// into out_code (digits + 1 bytes). Returns 0 on success, -1 on failure.
+int totp_code_at(hmac_engine *eng, uint64_t timestep, size_t digits,
+                 char *out_code);
+
+// Compute the current code for a base32 secret (exits on bad secret;
+// CLI-oriented). out_code must hold digits + 1 bytes.
+void compute_totp(const char *base32_secret, int window, char *out_code,
+                  size_t digits);
+
+// Verify a code against a base32 secret over +/- window timesteps.
+// Returns 1 on match, 0 otherwise.
+int verify_totp(const char *secret, const char *code, int window);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // AUTHTOOLS_H
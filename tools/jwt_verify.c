@@ -1,59 +1,2414 @@
 // Simple JWT HS256 verifier. Prints payload if signature valid.
-// Build with: gcc -o jwt_verify tools/jwt_verify.c -lcrypto
-// Usage: ./jwt_verify <jwt> <secret>
+// Build with: make tools (thin wrapper over libauthtools)
+// Usage:
+//   ./jwt_verify <jwt> <secret>
+//   ./jwt_verify --ed25519 <pubkey.pem> <jwt>
+//   ./jwt_verify --batch [tokens-file] [--mmap <file>] [--threads N]
+//                [--claims exp,sub] [--dedup] [--numa] [--stats]
+//                [--metrics <shm-name>] [--output-format <text|binary>]
+//                (--keyset <file> | --ed25519 <pubkey.pem> |
+//                 --secret-file <path> | JWT_SECRET env)
+//   ./jwt_verify --serve <socket-path> [--threads N] [--metrics <shm-name>]
+//                (--keyset <file> | --secret-file <path> | JWT_SECRET env)
+//
+// Batch mode reads newline-delimited tokens from stdin (or a file), verifies
+// them all in one process against a single secret, and prints one result line
+// per token: "<index> VALID|INVALID|MALFORMED", in input order. The HMAC key
+// schedule is set up once and cloned per worker thread; --threads shards the
+// token stream across a pool with work-stealing queues so skewed payload
+// sizes cannot leave cores idle. Stream input is double-buffered: a reader
+// thread fills one 8 MiB chunk while the workers verify the previous one,
+// so decompressor-fed pipes keep every verification thread busy. Results
+// are appended to an in-memory buffer and written once per chunk. With
+// --keyset, a "kid secret" file replaces the single secret: every key is
+// precomputed at load and each token's kid (parsed from its header during
+// the decode that happens anyway) selects the context via a hash table,
+// so one sweep covers any number of rotated keys. The first load also
+// compiles the keyset into a <file>.kcache binary sidecar (the serialized
+// table plus precomputed pad states); later startups mmap it and skip
+// the parse and key-schedule work entirely. --dedup adds a
+// lock-free verdict cache keyed on the 128-bit signature prefix, turning
+// repeated occurrences of the same token into a single table load. On
+// multi-socket hosts --numa pins workers to cores grouped by NUMA node,
+// first-touches each worker's slice of the input, prefers same-node
+// work stealing, and replicates the hot key state and dedup shards per
+// node. With --claims the requested top-level
+// payload fields of each valid token are extracted by a single-pass scanner
+// (no JSON document is built) and appended as tab-separated name=value
+// columns. --ed25519 switches the sweep from HS256 to EdDSA against one
+// PEM public key: the raw key is extracted once and every worker reuses
+// its own EVP_PKEY and digest context across its whole queue, so each
+// token costs only the Ed25519 point math. --stats wraps each pipeline stage (signature decode, HMAC,
+// compare, output) in rdtsc reads accumulated per worker and prints a
+// per-stage cycles/op and bytes/cycle table to stderr on exit; disabled
+// it costs one predicted branch per stage. --metrics maps a fixed-layout
+// POSIX shared-memory segment and keeps verdict totals, dedup hit rate
+// and per-stage cycle histograms updated with relaxed atomic adds (no
+// locks or syscalls per event) for the metrics_export Prometheus
+// sidecar to scrape. --output-format binary replaces the verdict lines
+// with fixed-width records (global token index, verdict, exp claim -
+// layout in authtools.h) that each worker buffers privately and flushes
+// straight from its loop with large vectored writes, cutting output
+// bytes roughly 10x on big sweeps and keeping stdio out of the hot
+// path; pipe the stream through verdict_read to get text back.
+//
+// Serve mode keeps the process resident as a verification sidecar: same
+// line protocol over a Unix socket, driven by an io_uring event loop
+// (multishot accept, provided-buffer receives, batched submits) so one
+// thread can sustain gateway-rate verification without per-request
+// syscall overhead.
+
+#define _GNU_SOURCE // cpu_set_t / pthread_setaffinity_np
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include <string.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <signal.h>
+#include <errno.h>
+#include <sched.h>
+#ifdef __linux__
+#include <linux/io_uring.h>
+#endif
 #include <openssl/hmac.h>
 #include <openssl/evp.h>
+#include <openssl/pem.h>
 
-// base64url decode
-unsigned char *b64url_decode(const char *input, size_t *out_len) {
-    size_t len = strlen(input);
-    // make a modifiable copy and replace URL-safe
-    char *tmp = malloc(len + 5);
-    if (!tmp) return NULL;
-    strcpy(tmp, input);
-    for (size_t i = 0; i < len; ++i) {
-        if (tmp[i] == '-') tmp[i] = '+';
-        else if (tmp[i] == '_') tmp[i] = '/';
-    }
-    // pad with '='
-    size_t pad = (4 - (len % 4)) % 4;
-    for (size_t i = 0; i < pad; ++i) strcat(tmp, "=");
-    BIO *b64 = BIO_new(BIO_f_base64());
-    BIO_set_flags(b64, BIO_FLAGS_BASE64_NO_NL);
-    BIO *bio = BIO_new_mem_buf(tmp, -1);
-    bio = BIO_push(b64, bio);
-    unsigned char *buffer = malloc(len);
-    int decoded_len = BIO_read(bio, buffer, len);
-    if (decoded_len <= 0) {
-        free(buffer);
-        buffer = NULL;
-        decoded_len = 0;
-    }
-    BIO_free_all(bio);
-    free(tmp);
-    *out_len = decoded_len;
-    return buffer;
-}
-
-int constant_time_cmp(const unsigned char *a, const unsigned char *b, size_t len) {
-    unsigned char diff = 0;
+#include "authtools.h"
+
+#define MAX_CLAIMS 8
+
+// Requested top-level claim names, parsed from --claims exp,sub,...
+typedef struct {
+    char names[MAX_CLAIMS][32];
+    int count;
+} claim_spec;
+
+static int parse_claim_spec(const char *arg, claim_spec *spec) {
+    spec->count = 0;
+    const char *p = arg;
+    while (*p) {
+        const char *comma = strchr(p, ',');
+        size_t len = comma ? (size_t)(comma - p) : strlen(p);
+        if (len == 0 || len >= sizeof(spec->names[0]) || spec->count == MAX_CLAIMS) {
+            return -1;
+        }
+        memcpy(spec->names[spec->count], p, len);
+        spec->names[spec->count][len] = '\0';
+        ++spec->count;
+        p = comma ? comma + 1 : p + len;
+    }
+    return spec->count > 0 ? 0 : -1;
+}
+
+// One pass over a decoded JSON payload, extracting the requested top-level
+// fields as raw slices. No document is built: the scanner tracks nesting
+// depth and string state only. Missing claims get NULL slices.
+static void scan_claims(const char *json, size_t len, const claim_spec *spec,
+                        const char **val_ptr, size_t *val_len) {
+    for (int i = 0; i < spec->count; ++i) {
+        val_ptr[i] = NULL;
+        val_len[i] = 0;
+    }
+
+    int depth = 0;
+    size_t i = 0;
+    while (i < len) {
+        char c = json[i];
+        if (c == '{' || c == '[') { ++depth; ++i; continue; }
+        if (c == '}' || c == ']') { --depth; ++i; continue; }
+        if (c != '"') { ++i; continue; }
+
+        // string start: capture it (it is a key iff depth 1 and followed by ':')
+        size_t start = ++i;
+        while (i < len && json[i] != '"') {
+            i += json[i] == '\\' ? 2 : 1;
+        }
+        if (i >= len) return;
+        size_t str_len = i - start;
+        ++i; // closing quote
+        while (i < len && (json[i] == ' ' || json[i] == '\t' ||
+                           json[i] == '\n' || json[i] == '\r')) ++i;
+        if (depth != 1 || i >= len || json[i] != ':') continue;
+        ++i; // ':'
+        while (i < len && (json[i] == ' ' || json[i] == '\t' ||
+                           json[i] == '\n' || json[i] == '\r')) ++i;
+        if (i >= len) return;
+
+        // locate the value slice
+        const char *vptr;
+        size_t vlen;
+        if (json[i] == '"') {
+            size_t vstart = ++i;
+            while (i < len && json[i] != '"') {
+                i += json[i] == '\\' ? 2 : 1;
+            }
+            vptr = json + vstart;
+            vlen = i - vstart;
+            if (i < len) ++i;
+        } else if (json[i] == '{' || json[i] == '[') {
+            // nested value: emit the raw JSON slice
+            size_t vstart = i;
+            int vdepth = 0;
+            while (i < len) {
+                char vc = json[i];
+                if (vc == '"') {
+                    ++i;
+                    while (i < len && json[i] != '"') {
+                        i += json[i] == '\\' ? 2 : 1;
+                    }
+                    if (i < len) ++i;
+                    continue;
+                }
+                if (vc == '{' || vc == '[') ++vdepth;
+                else if (vc == '}' || vc == ']') {
+                    if (--vdepth == 0) { ++i; break; }
+                }
+                ++i;
+            }
+            vptr = json + vstart;
+            vlen = i - vstart;
+        } else {
+            size_t vstart = i;
+            while (i < len && json[i] != ',' && json[i] != '}' &&
+                   json[i] != ' ' && json[i] != '\t' && json[i] != '\n' &&
+                   json[i] != '\r') ++i;
+            vptr = json + vstart;
+            vlen = i - vstart;
+        }
+
+        for (int k = 0; k < spec->count; ++k) {
+            if (!val_ptr[k] && strlen(spec->names[k]) == str_len &&
+                memcmp(spec->names[k], json + start, str_len) == 0) {
+                val_ptr[k] = vptr;
+                val_len[k] = vlen;
+            }
+        }
+    }
+}
+
+// Decode a valid token's payload and format "name=value" columns for the
+// requested claims. Returns a tab-separated string bump-allocated from the
+// worker's arena, or NULL.
+static char *extract_claims(const char *jwt, size_t jwt_len,
+                            const claim_spec *spec, unsigned char *scratch,
+                            size_t scratch_cap, bump_arena *arena) {
+    const char *dot1 = memchr(jwt, '.', jwt_len);
+    if (!dot1) return NULL;
+    const char *dot2 = memchr(dot1 + 1, '.', jwt_len - (dot1 - jwt) - 1);
+    if (!dot2) return NULL;
+
+    size_t pl_len;
+    if (b64url_decode_buf(dot1 + 1, dot2 - dot1 - 1, scratch, scratch_cap,
+                          &pl_len) != 0) {
+        return NULL;
+    }
+
+    const char *val_ptr[MAX_CLAIMS];
+    size_t val_len[MAX_CLAIMS];
+    scan_claims((const char *)scratch, pl_len, spec, val_ptr, val_len);
+
+    size_t need = 1;
+    for (int k = 0; k < spec->count; ++k) {
+        need += strlen(spec->names[k]) + 1 + (val_ptr[k] ? val_len[k] : 1) + 1;
+    }
+    char *out = arena_alloc(arena, need);
+    if (!out) return NULL;
+    char *w = out;
+    for (int k = 0; k < spec->count; ++k) {
+        if (k > 0) *w++ = '\t';
+        w += sprintf(w, "%s=", spec->names[k]);
+        if (val_ptr[k]) {
+            memcpy(w, val_ptr[k], val_len[k]);
+            w += val_len[k];
+        } else {
+            *w++ = '-';
+        }
+    }
+    *w = '\0';
+    return out;
+}
+
+// Load a secret from a file, trimming a trailing newline.
+static char *load_secret_file(const char *path) {
+    FILE *f = fopen(path, "r");
+    if (!f) return NULL;
+    char *secret = NULL;
+    size_t cap = 0;
+    ssize_t n = getline(&secret, &cap, f);
+    fclose(f);
+    if (n <= 0) {
+        free(secret);
+        return NULL;
+    }
+    while (n > 0 && (secret[n - 1] == '\n' || secret[n - 1] == '\r')) {
+        secret[--n] = '\0';
+    }
+    return secret;
+}
+
+// ---- keyset (kid -> precomputed HMAC context) ----
+//
+// Multi-tenant dumps mix tokens signed under many rotated keys. The
+// keyset file holds "kid secret" lines; every key is decoded and keyed
+// once at load, and the kid parsed from each token header selects the
+// right context through an open-addressing hash table - one pass over
+// the dump regardless of key count.
+
+typedef struct {
+    char *kid;                // NULL = empty slot
+    hmac_engine eng;          // keyed once; cloned per worker on the EVP path
+    hmac_sha256_padkey hwkey; // direct-kernel schedule for the same secret
+} keyset_entry;
+
+typedef struct {
+    keyset_entry *slots; // linear probing, built once, never resized
+    uint32_t cap;        // power of two
+    uint32_t count;
+} keyset;
+
+static uint64_t hash_kid(const char *s, size_t len) {
+    uint64_t h = 1469598103934665603ull; // FNV-1a
     for (size_t i = 0; i < len; ++i) {
-        diff |= a[i] ^ b[i];
+        h = (h ^ (unsigned char)s[i]) * 1099511628211ull;
+    }
+    return h;
+}
+
+// Returns the slot index for kid, or -1 when it is not in the set.
+static int keyset_find(const keyset *ks, const char *kid, size_t kid_len) {
+    uint32_t mask = ks->cap - 1;
+    uint32_t i = (uint32_t)hash_kid(kid, kid_len) & mask;
+    while (ks->slots[i].kid) {
+        if (strlen(ks->slots[i].kid) == kid_len &&
+            memcmp(ks->slots[i].kid, kid, kid_len) == 0) {
+            return (int)i;
+        }
+        i = (i + 1) & mask;
+    }
+    return -1;
+}
+
+// Load "kid secret" lines (whitespace separated). Returns 0 on success.
+static int keyset_load_text(const char *path, keyset *ks) {
+    FILE *f = fopen(path, "r");
+    if (!f) return -1;
+
+    // first pass: collect kid/secret pairs
+    char **kids = NULL, **secrets = NULL;
+    size_t cap = 0, count = 0;
+    char *line = NULL;
+    size_t lcap = 0;
+    ssize_t len;
+    int failed = 0;
+    while (!failed && (len = getline(&line, &lcap, f)) != -1) {
+        while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r')) {
+            line[--len] = '\0';
+        }
+        if (len == 0 || line[0] == '#') continue;
+        char *sep = strpbrk(line, " \t");
+        if (!sep) continue;
+        *sep = '\0';
+        char *secret = sep + 1;
+        while (*secret == ' ' || *secret == '\t') ++secret;
+        if (!*secret) continue;
+        if (count == cap) {
+            cap = cap ? cap * 2 : 16;
+            char **k2 = realloc(kids, cap * sizeof(*kids));
+            char **s2 = realloc(secrets, cap * sizeof(*secrets));
+            if (k2) kids = k2;
+            if (s2) secrets = s2;
+            if (!k2 || !s2) { failed = 1; break; }
+        }
+        kids[count] = strdup(line);
+        secrets[count] = strdup(secret);
+        if (!kids[count] || !secrets[count]) { failed = 1; break; }
+        ++count;
+    }
+    free(line);
+    fclose(f);
+
+    // build the table at <= 1/2 load so probes stay short
+    uint32_t tcap = 16;
+    while (tcap < count * 2) tcap *= 2;
+    ks->slots = failed ? NULL : calloc(tcap, sizeof(*ks->slots));
+    ks->cap = tcap;
+    ks->count = 0;
+    if (ks->slots) {
+        for (size_t n = 0; n < count; ++n) {
+            uint32_t mask = tcap - 1;
+            uint32_t i = (uint32_t)hash_kid(kids[n], strlen(kids[n])) & mask;
+            while (ks->slots[i].kid &&
+                   strcmp(ks->slots[i].kid, kids[n]) != 0) {
+                i = (i + 1) & mask;
+            }
+            keyset_entry *e = &ks->slots[i];
+            if (e->kid) { // duplicate kid: later line wins
+                free(kids[n]);
+                hmac_engine_free(&e->eng);
+            } else {
+                e->kid = kids[n];
+                ++ks->count;
+            }
+            if (hmac_engine_init(&e->eng, EVP_sha256(), secrets[n],
+                                 strlen(secrets[n])) != 0) {
+                failed = 1;
+            }
+            hmac_sha256_padkey_init(&e->hwkey,
+                                    (const unsigned char *)secrets[n],
+                                    strlen(secrets[n]));
+        }
+    } else {
+        failed = 1;
+        for (size_t n = 0; n < count; ++n) free(kids[n]);
+    }
+    for (size_t n = 0; n < count; ++n) free(secrets[n]);
+    free(kids);
+    free(secrets);
+    return failed ? -1 : 0;
+}
+
+// ---- binary keyset cache ----
+//
+// Parsing and keying a tens-of-thousands-entry keyset costs hundreds of
+// milliseconds, paid on every short-lived cron/CI invocation. The first
+// load with a hardware SHA unit compiles the keyset into <path>.kcache:
+// a fixed-layout file holding the open-addressing table exactly as
+// built (same cap, same slot order, so keyset_find works unchanged) with
+// each slot's precomputed HMAC pad states, plus one NUL-terminated
+// string blob for the kids. Later startups validate the source file's
+// size/mtime against the header, mmap the cache, copy the slot records
+// into the process table and point the kids straight into the mapping -
+// no text parse, no key schedule computation, and the string pages stay
+// shared read-only across concurrent invocations. Cached loads carry no
+// EVP engines, so CPUs without SHA acceleration (which need the
+// hmac_engine path) skip the cache and parse the text file as before.
+
+#define KCACHE_MAGIC 0x31686361636b736bull // "ksbcach1"
+
+typedef struct {
+    uint64_t magic;
+    uint64_t src_size;
+    uint64_t src_mtime;
+    uint32_t cap;
+    uint32_t count;
+    uint64_t strings_len;
+} kcache_header;
+
+typedef struct {
+    uint32_t kid_off; // offset into the string blob; UINT32_MAX = empty
+    uint32_t kid_len;
+    hmac_sha256_padkey hwkey;
+} kcache_slot;
+
+static void kcache_path(const char *path, char *out, size_t cap) {
+    snprintf(out, cap, "%s.kcache", path);
+}
+
+// Serialize a freshly text-loaded keyset. Best effort: written to a
+// temp file and renamed so concurrent invocations never see a partial
+// cache; failures just mean the next run parses text again.
+static void kcache_write(const char *path, const struct stat *src_st,
+                         const keyset *ks) {
+    char cache[4096], tmp[4120];
+    kcache_path(path, cache, sizeof(cache));
+    snprintf(tmp, sizeof(tmp), "%s.%d", cache, (int)getpid());
+    FILE *f = fopen(tmp, "w");
+    if (!f) return;
+
+    kcache_header hdr = { KCACHE_MAGIC, (uint64_t)src_st->st_size,
+                          (uint64_t)src_st->st_mtime, ks->cap, ks->count, 0 };
+    for (uint32_t i = 0; i < ks->cap; ++i) {
+        if (ks->slots[i].kid) hdr.strings_len += strlen(ks->slots[i].kid) + 1;
+    }
+    int ok = fwrite(&hdr, sizeof(hdr), 1, f) == 1;
+    uint32_t off = 0;
+    for (uint32_t i = 0; ok && i < ks->cap; ++i) {
+        kcache_slot rec = { UINT32_MAX, 0, {{0}, {0}} };
+        if (ks->slots[i].kid) {
+            rec.kid_off = off;
+            rec.kid_len = (uint32_t)strlen(ks->slots[i].kid);
+            rec.hwkey = ks->slots[i].hwkey;
+            off += rec.kid_len + 1;
+        }
+        ok = fwrite(&rec, sizeof(rec), 1, f) == 1;
+    }
+    for (uint32_t i = 0; ok && i < ks->cap; ++i) {
+        if (ks->slots[i].kid) {
+            ok = fwrite(ks->slots[i].kid, strlen(ks->slots[i].kid) + 1, 1,
+                        f) == 1;
+        }
+    }
+    if (fclose(f) != 0) ok = 0;
+    if (!ok || rename(tmp, cache) != 0) unlink(tmp);
+}
+
+// Populate ks from a valid cache, or return -1 to fall back to the text
+// parser. The mapping is kept for the life of the process (the kid
+// strings point into it).
+static int kcache_try_load(const char *path, const struct stat *src_st,
+                           keyset *ks) {
+    char cache[4096];
+    kcache_path(path, cache, sizeof(cache));
+    int fd = open(cache, O_RDONLY);
+    if (fd < 0) return -1;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(kcache_header)) {
+        close(fd);
+        return -1;
+    }
+    char *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) return -1;
+
+    const kcache_header *hdr = (const kcache_header *)map;
+    size_t need = sizeof(*hdr) + (size_t)hdr->cap * sizeof(kcache_slot) +
+                  hdr->strings_len;
+    if (hdr->magic != KCACHE_MAGIC ||
+        hdr->src_size != (uint64_t)src_st->st_size ||
+        hdr->src_mtime != (uint64_t)src_st->st_mtime ||
+        hdr->cap == 0 || (hdr->cap & (hdr->cap - 1)) != 0 ||
+        (size_t)st.st_size < need) {
+        munmap(map, st.st_size);
+        return -1;
+    }
+    const kcache_slot *recs = (const kcache_slot *)(hdr + 1);
+    char *strings = map + sizeof(*hdr) + (size_t)hdr->cap * sizeof(kcache_slot);
+
+    keyset_entry *slots = calloc(hdr->cap, sizeof(*slots));
+    if (!slots) {
+        munmap(map, st.st_size);
+        return -1;
+    }
+    for (uint32_t i = 0; i < hdr->cap; ++i) {
+        if (recs[i].kid_off == UINT32_MAX) continue;
+        if ((uint64_t)recs[i].kid_off + recs[i].kid_len + 1 >
+                hdr->strings_len ||
+            strings[recs[i].kid_off + recs[i].kid_len] != '\0') {
+            free(slots);
+            munmap(map, st.st_size);
+            return -1;
+        }
+        slots[i].kid = strings + recs[i].kid_off;
+        slots[i].hwkey = recs[i].hwkey;
+    }
+    ks->slots = slots;
+    ks->cap = hdr->cap;
+    ks->count = hdr->count;
+    return 0;
+}
+
+// Load a keyset, preferring the binary cache when the CPU's hardware
+// SHA path makes the cached pad states sufficient; (re)writes the cache
+// after a text parse. Returns 0 on success.
+static int keyset_load(const char *path, keyset *ks) {
+    struct stat st;
+    int have_st = stat(path, &st) == 0;
+    if (have_st && authtools_sha_accel() &&
+        kcache_try_load(path, &st, ks) == 0) {
+        return 0;
+    }
+    if (keyset_load_text(path, ks) != 0) return -1;
+    if (have_st && authtools_sha_accel()) kcache_write(path, &st, ks);
+    return 0;
+}
+
+// Decode the token header (first segment) and resolve its kid against
+// the keyset. Returns the slot index, -1 for an absent/unknown kid, -2
+// for an undecodable header.
+static int token_kid_slot(const keyset *ks, const char *jwt, size_t hdr_len) {
+    unsigned char hdr[512];
+    size_t dec_len;
+    if (b64url_decode_buf(jwt, hdr_len, hdr, sizeof(hdr), &dec_len) != 0) {
+        return -2;
+    }
+    static const claim_spec kid_spec = { { "kid" }, 1 };
+    const char *val_ptr[MAX_CLAIMS];
+    size_t val_len[MAX_CLAIMS];
+    scan_claims((const char *)hdr, dec_len, &kid_spec, val_ptr, val_len);
+    if (!val_ptr[0]) return -1;
+    return keyset_find(ks, val_ptr[0], val_len[0]);
+}
+
+// ---- NUMA placement (--numa) ----
+//
+// Dual-socket audit hosts lose a large slice of batch throughput to the
+// interconnect: workers migrate across sockets, the mmap'd dump faults
+// onto whichever node ran the tokenizer, and the shared key contexts and
+// dedup slots bounce between caches. --numa reads the node topology from
+// sysfs (no libnuma dependency, mirroring the raw-syscall io_uring
+// path), pins each worker to a CPU grouped by node, prefaults each
+// worker's slice of the input from its own node before tokenizing
+// (first-touch), steals work from same-node victims before crossing the
+// interconnect, and gives every node its own copy of the precomputed
+// HMAC key states and its own dedup shard. On a single-node host it
+// degrades to plain core pinning.
+
+#define NUMA_MAX_CPUS 1024
+#define NUMA_MAX_NODES 64
+
+typedef struct {
+    int ncpus;                     // CPUs usable by this process
+    int nnodes;                    // nodes with at least one such CPU
+    int cpus[NUMA_MAX_CPUS];       // CPU ids, node-major order
+    int cpu_node[NUMA_MAX_CPUS];   // node index (dense) per cpus[] entry
+} numa_topo;
+
+// Parse a sysfs cpulist ("0-3,8-11") into the topology, keeping only
+// CPUs in the process affinity mask.
+static void numa_topo_add_list(numa_topo *t, const char *list, int node,
+                               const cpu_set_t *allowed) {
+    const char *p = list;
+    while (*p && *p != '\n') {
+        char *end;
+        long lo = strtol(p, &end, 10);
+        long hi = lo;
+        if (*end == '-') hi = strtol(end + 1, &end, 10);
+        for (long c = lo; c <= hi && t->ncpus < NUMA_MAX_CPUS; ++c) {
+            if (c < CPU_SETSIZE && CPU_ISSET(c, allowed)) {
+                t->cpus[t->ncpus] = (int)c;
+                t->cpu_node[t->ncpus] = node;
+                ++t->ncpus;
+            }
+        }
+        p = (*end == ',') ? end + 1 : end;
+    }
+}
+
+// Returns 0 and fills the topology, or -1 when it cannot be determined
+// (the caller then runs without placement).
+static int numa_topo_load(numa_topo *t) {
+    memset(t, 0, sizeof(*t));
+    cpu_set_t allowed;
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) return -1;
+
+    for (int node = 0; node < NUMA_MAX_NODES; ++node) {
+        char path[64];
+        snprintf(path, sizeof(path),
+                 "/sys/devices/system/node/node%d/cpulist", node);
+        FILE *f = fopen(path, "r");
+        if (!f) break;
+        char list[4096];
+        int before = t->ncpus;
+        if (fgets(list, sizeof(list), f)) {
+            numa_topo_add_list(t, list, t->nnodes, &allowed);
+        }
+        fclose(f);
+        if (t->ncpus > before) ++t->nnodes;
     }
-    return diff == 0;
+    return (t->nnodes > 0 && t->ncpus > 0) ? 0 : -1;
+}
+
+// Process-wide placement state, set up once in main for --numa runs.
+static numa_topo numa_topology;
+static int numa_active = 0;
+
+static int numa_worker_cpu(int worker) {
+    return numa_topology.cpus[worker % numa_topology.ncpus];
 }
 
+static int numa_worker_node(int worker) {
+    return numa_topology.cpu_node[worker % numa_topology.ncpus];
+}
+
+static void numa_pin_self(int worker) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(numa_worker_cpu(worker), &set);
+    // best effort: an unpinnable worker still verifies correctly
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+}
+
+// Prefault worker threads: each pins itself, then touches one byte per
+// page of its slice so the kernel's first-touch policy places the pages
+// on that worker's node before the tokenizer scans them.
+typedef struct {
+    const char *base;
+    size_t len;
+    int worker;
+} numa_prefault_job;
+
+static void *numa_prefault_main(void *arg) {
+    numa_prefault_job *j = arg;
+    numa_pin_self(j->worker);
+    volatile const char *p = j->base;
+    size_t sink = 0;
+    for (size_t off = 0; off < j->len; off += 4096) sink += p[off];
+    (void)sink;
+    return NULL;
+}
+
+static void numa_prefault(const char *buf, size_t len, int nthreads) {
+    if (nthreads < 2 || len == 0) return;
+    pthread_t tids[NUMA_MAX_CPUS];
+    numa_prefault_job jobs[NUMA_MAX_CPUS];
+    if (nthreads > NUMA_MAX_CPUS) nthreads = NUMA_MAX_CPUS;
+    size_t per = len / nthreads;
+    int started = 0;
+    for (int t = 1; t < nthreads; ++t) {
+        jobs[t] = (numa_prefault_job){ buf + per * t,
+                                       t == nthreads - 1 ? len - per * t : per,
+                                       t };
+        if (pthread_create(&tids[t], NULL, numa_prefault_main, &jobs[t]) != 0)
+            break;
+        ++started;
+    }
+    jobs[0] = (numa_prefault_job){ buf, per, 0 };
+    numa_prefault_main(&jobs[0]);
+    for (int t = 1; t <= started; ++t) pthread_join(tids[t], NULL);
+}
+
+// ---- signature-prefix dedup cache ----
+//
+// Gateway logs repeat the same bearer token thousands of times inside a
+// session window. The optional --dedup cache remembers verdicts keyed on
+// the 128-bit prefix of the raw (already decoded) signature bytes: the
+// first half indexes a direct-mapped table, 62 bits of the second half
+// are the tag and the low 2 bits carry the verdict, so each slot is one
+// atomic 64-bit word - lookups and inserts are single loads/stores with
+// no locking to serialize the workers. Colliding entries just overwrite.
+
+#define DEDUP_SLOTS (1u << 20)
+
+typedef struct {
+    _Atomic uint64_t *slots;
+    uint32_t mask;
+} dedup_cache;
+
+static int dedup_init(dedup_cache *dc) {
+    dc->slots = calloc(DEDUP_SLOTS, sizeof(*dc->slots));
+    dc->mask = DEDUP_SLOTS - 1;
+    return dc->slots ? 0 : -1;
+}
+
+// Split the 128-bit signature prefix into slot index and tagged word.
+// *entry has verdict bits 00; a stored slot ors in verdict + 1.
+static void dedup_key(const unsigned char *sig, uint32_t mask,
+                      uint32_t *idx, uint64_t *entry) {
+    uint64_t lo, hi;
+    memcpy(&lo, sig, 8);
+    memcpy(&hi, sig + 8, 8);
+    // mix the index half so low-entropy signatures still spread
+    lo *= 0x9E3779B97F4A7C15ull;
+    *idx = (uint32_t)(lo >> 32) & mask;
+    *entry = hi & ~3ull;
+}
+
+// Returns the cached verdict (0/1), or -1 on miss.
+static int dedup_lookup(const dedup_cache *dc, uint32_t idx, uint64_t entry) {
+    uint64_t cur = atomic_load_explicit(&dc->slots[idx], memory_order_relaxed);
+    if ((cur & ~3ull) == entry && (cur & 3)) return (int)(cur & 3) - 1;
+    return -1;
+}
+
+static void dedup_store(dedup_cache *dc, uint32_t idx, uint64_t entry,
+                        int verdict) {
+    atomic_store_explicit(&dc->slots[idx], entry | (uint64_t)(verdict + 1),
+                          memory_order_relaxed);
+}
+
+
+// Per-node replicas for --numa: each node gets its own dedup shard and
+// its own copy of the keyset's precomputed HMAC pad states, built lazily
+// by the first worker that runs on the node (so the copy is first-touch
+// local). kid strings stay shared - only the hot key state is replicated.
+typedef struct {
+    dedup_cache dedup;
+    keyset ks_copy;
+    _Atomic int dedup_state; // 0 empty, 1 building, 2 ready
+    _Atomic int ks_state;
+    char pad[64];            // keep nodes off each other's cache lines
+} numa_node_state;
+
+static numa_node_state *numa_nodes;
+
+static dedup_cache *numa_node_dedup(int node) {
+    numa_node_state *ns = &numa_nodes[node];
+    int st = atomic_load_explicit(&ns->dedup_state, memory_order_acquire);
+    if (st != 2) {
+        int expected = 0;
+        if (atomic_compare_exchange_strong(&ns->dedup_state, &expected, 1)) {
+            if (dedup_init(&ns->dedup) != 0) ns->dedup.slots = NULL;
+            atomic_store_explicit(&ns->dedup_state, 2, memory_order_release);
+        } else {
+            while (atomic_load_explicit(&ns->dedup_state,
+                                        memory_order_acquire) != 2) {
+                sched_yield();
+            }
+        }
+    }
+    return ns->dedup.slots ? &ns->dedup : NULL;
+}
+
+static const keyset *numa_node_keyset(int node, const keyset *ks) {
+    numa_node_state *ns = &numa_nodes[node];
+    int st = atomic_load_explicit(&ns->ks_state, memory_order_acquire);
+    if (st != 2) {
+        int expected = 0;
+        if (atomic_compare_exchange_strong(&ns->ks_state, &expected, 1)) {
+            keyset_entry *copy = malloc(ks->cap * sizeof(*copy));
+            if (copy) {
+                memcpy(copy, ks->slots, ks->cap * sizeof(*copy));
+                ns->ks_copy = *ks;
+                ns->ks_copy.slots = copy;
+            }
+            atomic_store_explicit(&ns->ks_state, 2, memory_order_release);
+        } else {
+            while (atomic_load_explicit(&ns->ks_state,
+                                        memory_order_acquire) != 2) {
+                sched_yield();
+            }
+        }
+    }
+    return ns->ks_copy.slots ? &ns->ks_copy : ks;
+}
+
+// ---- Ed25519 (EdDSA) ----
+//
+// Service tokens are migrating from HS256 to EdDSA; --ed25519 <pub.pem>
+// switches the whole sweep to Ed25519 verification. OpenSSL exposes no
+// batch-verify entry point, so the batch variant amortizes everything
+// around the unavoidable scalar multiplications instead: the raw
+// 32-byte public key is extracted once at load, and each worker builds
+// its own EVP_PKEY handle (no cross-thread sharing of OpenSSL key
+// objects) and reuses a single EVP_MD_CTX across every token in its
+// queue, so per-signature cost is the two point multiplications and
+// nothing else.
+
+typedef struct {
+    unsigned char pub[32]; // raw Ed25519 public key
+} ed25519_key;
+
+// Load a PEM "PUBLIC KEY" file and extract the raw key bytes. Returns 0
+// on success, -1 on unreadable files or non-Ed25519 keys.
+static int ed25519_key_load(const char *path, ed25519_key *out) {
+    FILE *f = fopen(path, "r");
+    if (!f) return -1;
+    EVP_PKEY *pkey = PEM_read_PUBKEY(f, NULL, NULL, NULL);
+    fclose(f);
+    if (!pkey) return -1;
+    size_t len = sizeof(out->pub);
+    int ok = EVP_PKEY_id(pkey) == EVP_PKEY_ED25519 &&
+             EVP_PKEY_get_raw_public_key(pkey, out->pub, &len) == 1 &&
+             len == sizeof(out->pub);
+    EVP_PKEY_free(pkey);
+    return ok ? 0 : -1;
+}
+
+// Per-worker verification state, initialized once per thread.
+typedef struct {
+    EVP_PKEY *pkey;
+    EVP_MD_CTX *md; // reused across every verify on this worker
+} ed25519_verifier;
+
+static int ed25519_verifier_init(ed25519_verifier *v, const ed25519_key *k) {
+    v->pkey = EVP_PKEY_new_raw_public_key(EVP_PKEY_ED25519, NULL, k->pub,
+                                          sizeof(k->pub));
+    v->md = EVP_MD_CTX_new();
+    if (v->pkey && v->md) return 0;
+    EVP_PKEY_free(v->pkey);
+    EVP_MD_CTX_free(v->md);
+    v->pkey = NULL;
+    v->md = NULL;
+    return -1;
+}
+
+static void ed25519_verifier_free(ed25519_verifier *v) {
+    EVP_PKEY_free(v->pkey);
+    EVP_MD_CTX_free(v->md);
+}
+
+// Verify one 64-byte signature over msg. Ed25519 signs the message
+// directly (no prehash), hence the NULL digest in the init.
+static int ed25519_verify(ed25519_verifier *v, const unsigned char *sig,
+                          const unsigned char *msg, size_t msg_len) {
+    return EVP_DigestVerifyInit(v->md, NULL, NULL, NULL, v->pkey) == 1 &&
+           EVP_DigestVerify(v->md, sig, 64, msg, msg_len) == 1;
+}
+
+// ---- --stats stage accounting ----
+//
+// Batch pipeline stages for the --stats breakdown. Workers accumulate
+// into their own padded counter arrays; the main thread merges them into
+// stats_total after the join and prints the table on exit. With the flag
+// off every instrumentation point is a NULL test on vc->stats.
+enum { ST_DECODE, ST_MAC, ST_CMP, ST_OUTPUT, ST_STAGES };
+
+// mutable so --ed25519 can relabel the MAC column
+static const char *stat_stage_names[ST_STAGES] = {
+    "b64url_decode", "hmac_sha256", "compare", "output",
+};
+
+static int stats_enabled;
+static stat_counter stats_total[ST_STAGES];
+
+// Per-worker verification context. Single-key mode uses eng/hwkey for
+// every token; keyset mode looks the key up by the token's kid.
+typedef struct {
+    hmac_engine *eng;                // single-key engine (worker clone)
+    const hmac_sha256_padkey *hwkey; // non-NULL when hardware SHA is in use
+    const keyset *ks;                // NULL in single-key mode
+    hmac_engine *ks_engines;         // per-worker clones, slot-indexed (EVP path)
+    dedup_cache *dedup;              // NULL unless --dedup
+    stat_counter *stats;             // worker's ST_STAGES counters, NULL unless --stats
+    ed25519_verifier *ed;            // non-NULL in --ed25519 mode
+} verify_ctx;
+
+// Shared metrics segment (--metrics), mapped once in main; the ST_*
+// stage order matches the segment's stage arrays.
+static metrics_segment *metrics_seg;
+
+// One instrumentation point feeding both the per-worker --stats
+// counters and the shared metrics segment; a pair of predicted branches
+// when neither is active.
+static inline uint64_t vstamp(const verify_ctx *vc) {
+    return (vc->stats || metrics_seg) ? stat_cycles() : 0;
+}
+
+static inline void vsample(const verify_ctx *vc, int stage, uint64_t t0,
+                           uint64_t nbytes) {
+    if (!vc->stats && !metrics_seg) return;
+    uint64_t dt = stat_cycles() - t0;
+    if (vc->stats) {
+        vc->stats[stage].cycles += dt;
+        vc->stats[stage].bytes += nbytes;
+        vc->stats[stage].ops += 1;
+    }
+    if (metrics_seg) metrics_stage_sample(metrics_seg, stage, dt);
+}
+
+// res is a verify_token_ctx verdict: 1 valid, 0 invalid, -1 malformed.
+static inline void metrics_count_verdict(int res) {
+    if (metrics_seg) {
+        metrics_add(&metrics_seg->verdicts[res == 1 ? 0 : res == 0 ? 1 : 2],
+                    1);
+    }
+}
+
+// Verify one token. When the CPU has a hardware SHA unit the MAC goes
+// through the direct SHA-NI / ARMv8-CE HMAC-SHA256 kernel instead of
+// EVP. Returns 1 if the signature is valid, 0 if invalid (including an
+// unknown or missing kid in keyset mode), -1 if the token is malformed.
+static int verify_token_ctx(const verify_ctx *vc, const char *jwt,
+                            size_t jwt_len) {
+    const char *dot1 = memchr(jwt, '.', jwt_len);
+    if (!dot1) return -1;
+    const char *dot2 = memchr(dot1 + 1, '.', jwt_len - (dot1 - jwt) - 1);
+    if (!dot2) return -1;
+
+    size_t signing_input_len = dot2 - jwt;
+    size_t sig_b64_len = jwt_len - signing_input_len - 1;
+
+    unsigned char sig_dec[EVP_MAX_MD_SIZE];
+    size_t sig_dec_len;
+    uint64_t t0 = vstamp(vc);
+    if (b64url_decode_buf(dot2 + 1, sig_b64_len, sig_dec, sizeof(sig_dec),
+                          &sig_dec_len) != 0) {
+        return -1;
+    }
+    vsample(vc, ST_DECODE, t0, sig_b64_len);
+
+    uint32_t didx = 0;
+    uint64_t dentry = 0;
+    if (vc->dedup && sig_dec_len >= 16) {
+        dedup_key(sig_dec, vc->dedup->mask, &didx, &dentry);
+        int hit = dedup_lookup(vc->dedup, didx, dentry);
+        if (metrics_seg) {
+            metrics_add(&metrics_seg->dedup_lookups, 1);
+            if (hit >= 0) metrics_add(&metrics_seg->dedup_hits, 1);
+        }
+        if (hit >= 0) return hit;
+    }
+
+    hmac_engine *eng = vc->eng;
+    const hmac_sha256_padkey *hwkey = vc->hwkey;
+    if (vc->ks) {
+        int slot = token_kid_slot(vc->ks, jwt, dot1 - jwt);
+        if (slot == -1) return 0;  // unknown or absent kid
+        if (slot == -2) return -1; // undecodable header
+        if (vc->ks_engines) {
+            eng = &vc->ks_engines[slot];
+            hwkey = NULL;
+        } else {
+            hwkey = &vc->ks->slots[slot].hwkey;
+        }
+    }
+
+    unsigned char mac[EVP_MAX_MD_SIZE];
+    unsigned int mac_len = 0;
+    int valid = 0;
+    if (vc->ed) {
+        t0 = vstamp(vc);
+        valid = sig_dec_len == 64 &&
+                ed25519_verify(vc->ed, sig_dec, (const unsigned char *)jwt,
+                               signing_input_len);
+        vsample(vc, ST_MAC, t0, signing_input_len);
+    } else if (hwkey) {
+        t0 = vstamp(vc);
+        hmac_sha256_mac(hwkey, (const unsigned char *)jwt, signing_input_len,
+                        mac);
+        vsample(vc, ST_MAC, t0, signing_input_len);
+        t0 = vstamp(vc);
+        valid = sig_dec_len == 32 && constant_time_cmp32(mac, sig_dec);
+        vsample(vc, ST_CMP, t0, sig_dec_len);
+    } else {
+        t0 = vstamp(vc);
+        int mac_ok = hmac_engine_mac(eng, (const unsigned char *)jwt,
+                                     signing_input_len, mac, &mac_len) == 0;
+        vsample(vc, ST_MAC, t0, signing_input_len);
+        if (mac_ok && mac_len == sig_dec_len) {
+            // HMAC-SHA256 MACs are always 32 bytes; take the unrolled compare
+            t0 = vstamp(vc);
+            valid = mac_len == 32 ? constant_time_cmp32(mac, sig_dec)
+                                  : constant_time_cmp(mac, sig_dec, mac_len);
+            vsample(vc, ST_CMP, t0, sig_dec_len);
+        }
+    }
+    if (vc->dedup && sig_dec_len >= 16) {
+        dedup_store(vc->dedup, didx, dentry, valid);
+    }
+    return valid;
+}
+
+// A token slice into the batch input buffer.
+typedef struct {
+    const char *ptr;
+    size_t len;
+} token_slice;
+
+// Split a buffer into newline-delimited token slices in place: no copies,
+// each slice is a pointer+length view into the buffer. Returns 0 on
+// success; caller frees *toks_out.
+static int split_tokens(const char *buf, size_t len, token_slice **toks_out,
+                        size_t *count_out) {
+    size_t tok_cap = 1024, tok_count = 0;
+    token_slice *toks = malloc(tok_cap * sizeof(*toks));
+    if (!toks) return -1;
+    size_t start = 0;
+    for (size_t i = 0; i <= len; ++i) {
+        if (i == len || buf[i] == '\n') {
+            size_t tlen = i - start;
+            while (tlen > 0 && buf[start + tlen - 1] == '\r') --tlen;
+            if (tlen > 0) {
+                if (tok_count == tok_cap) {
+                    tok_cap *= 2;
+                    token_slice *grown = realloc(toks, tok_cap * sizeof(*toks));
+                    if (!grown) { free(toks); return -1; }
+                    toks = grown;
+                }
+                toks[tok_count].ptr = buf + start;
+                toks[tok_count].len = tlen;
+                ++tok_count;
+            }
+            start = i + 1;
+        }
+    }
+    *toks_out = toks;
+    *count_out = tok_count;
+    return 0;
+}
+
+// Growable result buffer: verdict lines are appended here and written out
+// once per chunk instead of a stdio call per token.
+typedef struct {
+    char *data;
+    size_t len, cap;
+} out_buf;
+
+static int ob_append(out_buf *ob, const char *s, size_t n) {
+    if (ob->len + n > ob->cap) {
+        size_t cap = ob->cap ? ob->cap : 1 << 20;
+        while (ob->len + n > cap) cap *= 2;
+        char *grown = realloc(ob->data, cap);
+        if (!grown) return -1;
+        ob->data = grown;
+        ob->cap = cap;
+    }
+    memcpy(ob->data + ob->len, s, n);
+    ob->len += n;
+    return 0;
+}
+
+static int ob_flush(out_buf *ob) {
+    if (ob->len &&
+        fwrite(ob->data, 1, ob->len, stdout) != ob->len) {
+        return -1;
+    }
+    ob->len = 0;
+    return 0;
+}
+
+// ---- binary verdict output (--output-format binary) ----
+//
+// Text verdict lines inflate 40M-token sweeps to gigabytes that
+// downstream jobs re-parse, and funnel every worker through one stdio
+// stream. Binary mode writes fixed-width verdict_rec entries (global
+// token index, verdict, exp claim - layout in authtools.h) instead:
+// each worker fills its own record buffer and flushes it to stdout with
+// one vectored write per ~16k records, serialized only by a mutex held
+// for the writev itself. Records carry the token index, so no
+// inter-worker ordering is needed; verdict_read restores text.
+
+static int binary_out;
+
+#define VOUT_FLUSH_RECS 16384 // per-worker buffer, ~384 KiB
+#define VOUT_IOV_RECS 4096    // records per iovec within a flush
+
+static pthread_mutex_t vout_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Write a worker's buffered records as one gathered batch. The lock
+// only orders whole flushes; workers never contend per token.
+static int vout_flush(const verdict_rec *recs, size_t count) {
+    struct iovec iov[(VOUT_FLUSH_RECS + VOUT_IOV_RECS - 1) / VOUT_IOV_RECS];
+    int niov = 0;
+    for (size_t off = 0; off < count; off += VOUT_IOV_RECS) {
+        size_t n = count - off < VOUT_IOV_RECS ? count - off : VOUT_IOV_RECS;
+        iov[niov].iov_base = (void *)(recs + off);
+        iov[niov].iov_len = n * sizeof(*recs);
+        ++niov;
+    }
+    int failed = 0;
+    pthread_mutex_lock(&vout_lock);
+    int i = 0;
+    while (i < niov) {
+        ssize_t w = writev(STDOUT_FILENO, iov + i, niov - i);
+        if (w < 0) {
+            if (errno == EINTR) continue;
+            failed = 1;
+            break;
+        }
+        while (i < niov && (size_t)w >= iov[i].iov_len) {
+            w -= (ssize_t)iov[i].iov_len;
+            ++i;
+        }
+        if (i < niov && w > 0) {
+            iov[i].iov_base = (char *)iov[i].iov_base + w;
+            iov[i].iov_len -= (size_t)w;
+        }
+    }
+    pthread_mutex_unlock(&vout_lock);
+    return failed ? -1 : 0;
+}
+
+// Pull a valid token's numeric exp claim for the record, or -1.
+static int64_t token_exp_claim(const char *jwt, size_t jwt_len,
+                               unsigned char *scratch, size_t scratch_cap) {
+    const char *dot1 = memchr(jwt, '.', jwt_len);
+    if (!dot1) return -1;
+    const char *dot2 = memchr(dot1 + 1, '.', jwt_len - (dot1 - jwt) - 1);
+    if (!dot2) return -1;
+    size_t pl_len;
+    if (b64url_decode_buf(dot1 + 1, dot2 - dot1 - 1, scratch, scratch_cap,
+                          &pl_len) != 0) {
+        return -1;
+    }
+    static const claim_spec exp_spec = { { "exp" }, 1 };
+    const char *val_ptr[MAX_CLAIMS];
+    size_t val_len[MAX_CLAIMS];
+    scan_claims((const char *)scratch, pl_len, &exp_spec, val_ptr, val_len);
+    if (!val_ptr[0] || val_len[0] == 0 || val_len[0] >= 20) return -1;
+    char tmp[20];
+    memcpy(tmp, val_ptr[0], val_len[0]);
+    tmp[val_len[0]] = '\0';
+    char *end = NULL;
+    long long v = strtoll(tmp, &end, 10);
+    return end != tmp && *end == '\0' && v >= 0 ? (int64_t)v : -1;
+}
+
+// Work-stealing range deque: head and tail indices into the shared token
+// array, packed into one 64-bit word so pop and steal are single CAS ops.
+// The owner pops from the head; an idle worker steals the upper half of a
+// victim's remaining range. Tokens vary wildly in payload size, so static
+// partitioning leaves cores idle on skewed inputs.
+typedef struct {
+    _Atomic uint64_t range; // high 32 bits: head, low 32 bits: tail
+    char pad[56];           // keep queues on separate cache lines
+} work_queue;
+
+static inline uint64_t range_pack(uint32_t head, uint32_t tail) {
+    return (uint64_t)head << 32 | tail;
+}
+
+// Pop one index from the owner's side. Returns 0 if the queue is empty.
+static int wq_pop(work_queue *q, uint32_t *idx) {
+    uint64_t r = atomic_load_explicit(&q->range, memory_order_relaxed);
+    for (;;) {
+        uint32_t head = (uint32_t)(r >> 32), tail = (uint32_t)r;
+        if (head >= tail) return 0;
+        if (atomic_compare_exchange_weak_explicit(&q->range, &r,
+                                                  range_pack(head + 1, tail),
+                                                  memory_order_acq_rel,
+                                                  memory_order_relaxed)) {
+            *idx = head;
+            return 1;
+        }
+    }
+}
+
+// Steal the upper half of a victim's remaining range into the thief's own
+// queue. Returns 0 if there was nothing to steal.
+static int wq_steal(work_queue *victim, work_queue *self) {
+    uint64_t r = atomic_load_explicit(&victim->range, memory_order_acquire);
+    for (;;) {
+        uint32_t head = (uint32_t)(r >> 32), tail = (uint32_t)r;
+        if (head >= tail) return 0;
+        uint32_t take = (tail - head + 1) / 2;
+        if (atomic_compare_exchange_weak_explicit(&victim->range, &r,
+                                                  range_pack(head, tail - take),
+                                                  memory_order_acq_rel,
+                                                  memory_order_acquire)) {
+            atomic_store_explicit(&self->range,
+                                  range_pack(tail - take, tail),
+                                  memory_order_release);
+            return 1;
+        }
+    }
+}
+
+typedef struct {
+    const token_slice *toks;
+    signed char *verdicts; // 1 valid, 0 invalid, -1 malformed
+    char **claims_out;     // per-token claim columns, NULL when not requested
+    const claim_spec *claims;
+    work_queue *queues;
+    int nthreads;
+    int self;
+    const hmac_engine *template_eng;    // NULL in keyset mode
+    const hmac_sha256_padkey *hwkey;    // non-NULL when hardware SHA is in use
+    const keyset *ks;                   // NULL in single-key mode
+    dedup_cache *dedup;                 // NULL unless --dedup
+    const ed25519_key *ed_key;          // non-NULL in --ed25519 mode
+    size_t index_base;     // global index of token 0 in this chunk
+    verdict_rec *recs;     // binary-mode record buffer, NULL in text mode
+    size_t rec_count;
+    bump_arena arena;      // per-worker storage for claim strings and scratch
+    int failed;
+    stat_counter stats[ST_STAGES]; // --stats accumulators, this worker only
+    char pad[64];          // keep neighbouring workers' counters apart
+} batch_worker;
+
+#define CLAIM_SCRATCH_CAP (64 * 1024)
+
+static void *batch_worker_main(void *arg) {
+    batch_worker *w = arg;
+    hmac_engine eng = {0};
+    hmac_engine *ks_engines = NULL;
+    ed25519_verifier ed = {0};
+    verify_ctx vc = { NULL, w->hwkey, w->ks, NULL, w->dedup,
+                      stats_enabled ? w->stats : NULL, NULL };
+    hmac_sha256_padkey local_hwkey;
+    int node = 0;
+    if (numa_active) {
+        numa_pin_self(w->self);
+        node = numa_worker_node(w->self);
+        if (w->dedup) vc.dedup = numa_node_dedup(node);
+        if (w->ks) vc.ks = numa_node_keyset(node, w->ks);
+        if (w->hwkey) {
+            // node-local copy of the single-key pad state
+            local_hwkey = *w->hwkey;
+            vc.hwkey = &local_hwkey;
+        }
+    }
+    if (w->ed_key) {
+        if (ed25519_verifier_init(&ed, w->ed_key) != 0) {
+            w->failed = 1;
+            return NULL;
+        }
+        vc.ed = &ed;
+        vc.hwkey = NULL;
+    } else if (!w->ks) {
+        if (hmac_engine_clone(&eng, w->template_eng) != 0) {
+            w->failed = 1;
+            return NULL;
+        }
+        vc.eng = &eng;
+    } else if (!authtools_sha_accel()) {
+        // EVP path: clone every key's engine once for this worker
+        ks_engines = calloc(w->ks->cap, sizeof(*ks_engines));
+        if (!ks_engines) {
+            w->failed = 1;
+            return NULL;
+        }
+        for (uint32_t i = 0; i < w->ks->cap; ++i) {
+            if (w->ks->slots[i].kid &&
+                hmac_engine_clone(&ks_engines[i], &w->ks->slots[i].eng) != 0) {
+                w->failed = 1;
+            }
+        }
+        vc.ks_engines = ks_engines;
+    }
+    if (w->failed) {
+        free(ks_engines);
+        return NULL;
+    }
+
+    unsigned char *scratch = NULL;
+    if (w->claims || w->recs) {
+        scratch = arena_alloc(&w->arena, CLAIM_SCRATCH_CAP);
+        if (!scratch) {
+            w->failed = 1;
+            if (vc.ed) ed25519_verifier_free(&ed);
+            if (vc.eng) hmac_engine_free(&eng);
+            free(ks_engines);
+            return NULL;
+        }
+    }
+
+    work_queue *self = &w->queues[w->self];
+    for (;;) {
+        uint32_t idx;
+        if (wq_pop(self, &idx)) {
+            int res = verify_token_ctx(&vc, w->toks[idx].ptr,
+                                       w->toks[idx].len);
+            metrics_count_verdict(res);
+            w->verdicts[idx] = (signed char)res;
+            if (res == 1 && w->claims) {
+                w->claims_out[idx] = extract_claims(
+                    w->toks[idx].ptr, w->toks[idx].len, w->claims,
+                    scratch, CLAIM_SCRATCH_CAP, &w->arena);
+            }
+            if (w->recs) {
+                verdict_rec *r = &w->recs[w->rec_count++];
+                r->index = w->index_base + idx;
+                r->exp = res == 1 ? token_exp_claim(w->toks[idx].ptr,
+                                                    w->toks[idx].len, scratch,
+                                                    CLAIM_SCRATCH_CAP)
+                                  : -1;
+                r->verdict = res;
+                r->pad = 0;
+                if (w->rec_count == VOUT_FLUSH_RECS) {
+                    if (vout_flush(w->recs, w->rec_count) != 0) w->failed = 1;
+                    w->rec_count = 0;
+                }
+            }
+            continue;
+        }
+        // own queue drained: try to steal half of someone else's range,
+        // preferring victims on the same node before crossing sockets
+        int stole = 0;
+        for (int pass = 0; pass < (numa_active ? 2 : 1) && !stole; ++pass) {
+            for (int v = 1; v < w->nthreads && !stole; ++v) {
+                int victim = (w->self + v) % w->nthreads;
+                if (numa_active && pass == 0 &&
+                    numa_worker_node(victim) != node) {
+                    continue;
+                }
+                stole = wq_steal(&w->queues[victim], self);
+            }
+        }
+        if (!stole) break;
+    }
+
+    if (w->recs && w->rec_count) {
+        if (vout_flush(w->recs, w->rec_count) != 0) w->failed = 1;
+        w->rec_count = 0;
+    }
+
+    if (vc.ed) ed25519_verifier_free(&ed);
+    if (vc.eng) hmac_engine_free(&eng);
+    if (ks_engines) {
+        for (uint32_t i = 0; i < w->ks->cap; ++i) {
+            if (w->ks->slots[i].kid) hmac_engine_free(&ks_engines[i]);
+        }
+        free(ks_engines);
+    }
+    return NULL;
+}
+
+// Verify every token in buf (not owned) against an already-keyed engine
+// and append verdict lines to ob in input order. index_base offsets the
+// printed indices so streamed chunks stay globally numbered. Returns 0 on
+// success and stores the token count in *count_out.
+static int verify_buffer(const char *buf, size_t buf_len,
+                         const hmac_engine *eng,
+                         const hmac_sha256_padkey *hwkey_p, const keyset *ks,
+                         dedup_cache *dedup, const ed25519_key *ed,
+                         int nthreads, const claim_spec *claims,
+                         size_t index_base, out_buf *ob, size_t *count_out) {
+    token_slice *toks;
+    size_t count;
+    *count_out = 0;
+    if (numa_active) numa_prefault(buf, buf_len, nthreads);
+    if (split_tokens(buf, buf_len, &toks, &count) != 0) {
+        fprintf(stderr, "out of memory splitting input\n");
+        return 1;
+    }
+
+    if (nthreads < 1) nthreads = 1;
+    if ((size_t)nthreads > count && count > 0) nthreads = (int)count;
+    if (count > UINT32_MAX) {
+        fprintf(stderr, "too many tokens in one batch\n");
+        free(toks);
+        return 1;
+    }
+
+    signed char *verdicts = malloc(count ? count : 1);
+    char **claims_out = claims ? calloc(count ? count : 1, sizeof(char *)) : NULL;
+    work_queue *queues = calloc(nthreads, sizeof(*queues));
+    batch_worker *workers = calloc(nthreads, sizeof(*workers));
+    pthread_t *tids = calloc(nthreads, sizeof(*tids));
+    // one contiguous block, sliced per worker; each slice flushes on its own
+    verdict_rec *recs = binary_out
+        ? malloc((size_t)nthreads * VOUT_FLUSH_RECS * sizeof(*recs)) : NULL;
+    if (!verdicts || !queues || !workers || !tids ||
+        (claims && !claims_out) || (binary_out && !recs)) {
+        fprintf(stderr, "out of memory\n");
+        free(toks); free(verdicts); free(claims_out); free(queues); free(workers); free(tids);
+        free(recs);
+        return 1;
+    }
+
+    // seed each queue with an equal contiguous range; stealing rebalances
+    size_t per = count / nthreads, extra = count % nthreads, pos = 0;
+    for (int t = 0; t < nthreads; ++t) {
+        size_t n = per + (t < (int)extra ? 1 : 0);
+        atomic_store(&queues[t].range,
+                     range_pack((uint32_t)pos, (uint32_t)(pos + n)));
+        pos += n;
+        workers[t] = (batch_worker){ toks, verdicts, claims_out, claims,
+                                     queues, nthreads, t, eng, hwkey_p, ks,
+                                     dedup, ed, index_base,
+                                     recs ? recs + (size_t)t * VOUT_FLUSH_RECS
+                                          : NULL,
+                                     0, {0}, 0 };
+        arena_init(&workers[t].arena, 0);
+    }
+
+    int failed = 0;
+    for (int t = 1; t < nthreads; ++t) {
+        if (pthread_create(&tids[t], NULL, batch_worker_main, &workers[t]) != 0) {
+            fprintf(stderr, "pthread_create failed\n");
+            failed = 1;
+            // unreachable work stays in the queue; drain it on this thread
+            break;
+        }
+    }
+    batch_worker_main(&workers[0]);
+    for (int t = 1; t < nthreads; ++t) {
+        if (tids[t]) pthread_join(tids[t], NULL);
+        failed |= workers[t].failed;
+    }
+    failed |= workers[0].failed;
+
+    if (!failed && !binary_out) {
+        stat_counter *st = stats_enabled ? workers[0].stats : NULL;
+        size_t ob_start = ob->len;
+        uint64_t t0 = stat_begin(st);
+        char line[64];
+        for (size_t i = 0; i < count && !failed; ++i) {
+            const char *verdict = verdicts[i] == 1 ? "VALID"
+                                : verdicts[i] == 0 ? "INVALID" : "MALFORMED";
+            int n;
+            if (claims) {
+                n = snprintf(line, sizeof(line), "%zu\t%s\t", index_base + i,
+                             verdict);
+                const char *cols = claims_out[i] ? claims_out[i] : "-";
+                failed |= ob_append(ob, line, (size_t)n) != 0 ||
+                          ob_append(ob, cols, strlen(cols)) != 0 ||
+                          ob_append(ob, "\n", 1) != 0;
+            } else {
+                n = snprintf(line, sizeof(line), "%zu %s\n", index_base + i,
+                             verdict);
+                failed |= ob_append(ob, line, (size_t)n) != 0;
+            }
+        }
+        stat_end(st, ST_OUTPUT, t0, ob->len - ob_start);
+    }
+
+    if (stats_enabled) {
+        // workers are freed per chunk in stream mode; fold into the
+        // process-wide totals before they go (main thread, post-join)
+        for (int t = 0; t < nthreads; ++t) {
+            for (int s = 0; s < ST_STAGES; ++s) {
+                stats_total[s].cycles += workers[t].stats[s].cycles;
+                stats_total[s].bytes += workers[t].stats[s].bytes;
+                stats_total[s].ops += workers[t].stats[s].ops;
+            }
+        }
+    }
+
+    for (int t = 0; t < nthreads; ++t) {
+        arena_destroy(&workers[t].arena);
+    }
+    free(claims_out);
+    free(toks);
+    free(verdicts);
+    free(queues);
+    free(workers);
+    free(tids);
+    free(recs);
+    *count_out = count;
+    return failed ? 1 : 0;
+}
+
+// Key the engine once (single-key mode) and verify one fully in-memory
+// buffer (the --mmap path).
+static int run_batch(const char *buf, size_t buf_len, const char *secret,
+                     const keyset *ks, dedup_cache *dedup,
+                     const ed25519_key *ed, int nthreads,
+                     const claim_spec *claims) {
+    hmac_engine eng = {0};
+    hmac_sha256_padkey hwkey;
+    const hmac_sha256_padkey *hwkey_p = NULL;
+    if (!ks && !ed) {
+        if (hmac_engine_init(&eng, EVP_sha256(), secret, strlen(secret)) != 0) {
+            fprintf(stderr, "HMAC init failed\n");
+            return 1;
+        }
+        if (authtools_sha_accel()) {
+            hmac_sha256_padkey_init(&hwkey, (const unsigned char *)secret,
+                                    strlen(secret));
+            hwkey_p = &hwkey;
+        }
+    }
+
+    out_buf ob = {0};
+    size_t count;
+    int failed = verify_buffer(buf, buf_len, &eng, hwkey_p, ks, dedup, ed,
+                               nthreads, claims, 0, &ob, &count);
+    failed |= ob_flush(&ob) != 0;
+    free(ob.data);
+    if (!ks && !ed) hmac_engine_free(&eng);
+    return failed ? 1 : 0;
+}
+
+// ---- pipelined stream input ----
+//
+// Piped input (zstdcat | jwt_verify --batch) would otherwise serialize
+// read syscalls against verification. A dedicated reader thread fills one
+// large buffer while the workers drain the previously filled one; the two
+// sides hand buffers back and forth over a condvar.
+
+#define STREAM_CHUNK_CAP (8u << 20)
+
+typedef struct {
+    char *data;  // STREAM_CHUNK_CAP bytes
+    size_t len;  // whole lines only; partial tails carry into the next fill
+    int full;    // owned by the verifier when set, by the reader when clear
+    int eof;     // no chunk follows this one
+} stream_chunk;
+
+typedef struct {
+    stream_chunk chunk[2];
+    pthread_mutex_t lock;
+    pthread_cond_t can_fill, can_drain;
+    FILE *in;
+    int failed;
+} stream_pipe;
+
+static void *stream_reader_main(void *arg) {
+    stream_pipe *p = arg;
+    char *carry = malloc(STREAM_CHUNK_CAP);
+    size_t carry_len = 0;
+    int slot = 0, eof = 0;
+
+    while (!eof) {
+        stream_chunk *c = &p->chunk[slot];
+        pthread_mutex_lock(&p->lock);
+        while (c->full) pthread_cond_wait(&p->can_fill, &p->lock);
+        pthread_mutex_unlock(&p->lock);
+
+        size_t len = 0;
+        if (!carry) {
+            p->failed = 1;
+            eof = 1;
+        } else {
+            memcpy(c->data, carry, carry_len);
+            len = carry_len;
+            carry_len = 0;
+            size_t want = STREAM_CHUNK_CAP - len;
+            size_t n = fread(c->data + len, 1, want, p->in);
+            len += n;
+            eof = n < want; // fread only comes up short on EOF or error
+            if (!eof) {
+                // hand off whole lines only; the partial tail carries over
+                size_t cut = len;
+                while (cut > 0 && c->data[cut - 1] != '\n') --cut;
+                if (cut == 0) {
+                    fprintf(stderr, "token longer than %u bytes\n",
+                            STREAM_CHUNK_CAP);
+                    p->failed = 1;
+                    eof = 1;
+                } else {
+                    carry_len = len - cut;
+                    memcpy(carry, c->data + cut, carry_len);
+                    len = cut;
+                }
+            }
+        }
+
+        pthread_mutex_lock(&p->lock);
+        c->len = len;
+        c->eof = eof;
+        c->full = 1;
+        pthread_cond_signal(&p->can_drain);
+        pthread_mutex_unlock(&p->lock);
+        slot ^= 1;
+    }
+    free(carry);
+    return NULL;
+}
+
+// Verify a stream chunk by chunk, reading ahead on the reader thread.
+static int run_batch_stream(FILE *in, const char *secret, const keyset *ks,
+                            dedup_cache *dedup, const ed25519_key *ed,
+                            int nthreads, const claim_spec *claims) {
+    hmac_engine eng = {0};
+    hmac_sha256_padkey hwkey;
+    const hmac_sha256_padkey *hwkey_p = NULL;
+    if (!ks && !ed) {
+        if (hmac_engine_init(&eng, EVP_sha256(), secret, strlen(secret)) != 0) {
+            fprintf(stderr, "HMAC init failed\n");
+            return 1;
+        }
+        if (authtools_sha_accel()) {
+            hmac_sha256_padkey_init(&hwkey, (const unsigned char *)secret,
+                                    strlen(secret));
+            hwkey_p = &hwkey;
+        }
+    }
+
+    stream_pipe pipe = { .in = in };
+    pipe.chunk[0].data = malloc(STREAM_CHUNK_CAP);
+    pipe.chunk[1].data = malloc(STREAM_CHUNK_CAP);
+    pthread_mutex_init(&pipe.lock, NULL);
+    pthread_cond_init(&pipe.can_fill, NULL);
+    pthread_cond_init(&pipe.can_drain, NULL);
+    pthread_t reader;
+    int failed = 0;
+    if (!pipe.chunk[0].data || !pipe.chunk[1].data ||
+        pthread_create(&reader, NULL, stream_reader_main, &pipe) != 0) {
+        fprintf(stderr, "cannot start stream reader\n");
+        failed = 1;
+    }
+
+    out_buf ob = {0};
+    if (!failed) {
+        size_t index_base = 0;
+        int slot = 0, eof = 0;
+        while (!eof) {
+            stream_chunk *c = &pipe.chunk[slot];
+            pthread_mutex_lock(&pipe.lock);
+            while (!c->full) pthread_cond_wait(&pipe.can_drain, &pipe.lock);
+            pthread_mutex_unlock(&pipe.lock);
+
+            size_t count = 0;
+            if (c->len) {
+                failed |= verify_buffer(c->data, c->len, &eng, hwkey_p, ks,
+                                        dedup, ed, nthreads, claims,
+                                        index_base, &ob, &count);
+                failed |= ob_flush(&ob) != 0;
+                index_base += count;
+            }
+            eof = c->eof;
+
+            pthread_mutex_lock(&pipe.lock);
+            c->full = 0;
+            pthread_cond_signal(&pipe.can_fill);
+            pthread_mutex_unlock(&pipe.lock);
+            slot ^= 1;
+        }
+        pthread_join(reader, NULL);
+        failed |= pipe.failed;
+    }
+
+    free(ob.data);
+    free(pipe.chunk[0].data);
+    free(pipe.chunk[1].data);
+    pthread_mutex_destroy(&pipe.lock);
+    pthread_cond_destroy(&pipe.can_fill);
+    pthread_cond_destroy(&pipe.can_drain);
+    if (!ks && !ed) hmac_engine_free(&eng);
+    return failed ? 1 : 0;
+}
+
+
+#ifdef __linux__
+
+// ---- serve mode (io_uring verification sidecar) ----
+//
+// Online revocation checks want jwt_verify resident next to the gateway
+// rather than forked per dump. Serve mode listens on a Unix socket with
+// the same line protocol as batch mode (one token per line, one
+// "VALID|INVALID|MALFORMED" line back) and runs the event loop on raw
+// io_uring: the listen socket uses multishot accept, every connection a
+// multishot receive with provided buffers, and verdict writes are queued
+// onto the same ring - so a steady connection costs no syscalls beyond
+// the one io_uring_enter per batch of completions. Each serve thread
+// owns a full ring plus its accepted connections; the kernel spreads new
+// connections across the threads' parallel multishot accepts.
+
+static int sys_io_uring_setup(unsigned entries, struct io_uring_params *p) {
+    return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int sys_io_uring_enter(int fd, unsigned to_submit,
+                              unsigned min_complete, unsigned flags) {
+    return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete,
+                        flags, NULL, 0);
+}
+
+static int sys_io_uring_register(int fd, unsigned op, void *arg, unsigned nr) {
+    return (int)syscall(__NR_io_uring_register, fd, op, arg, nr);
+}
+
+#define SERVE_RING_ENTRIES 256
+#define SERVE_BUF_COUNT 256  // provided receive buffers per thread
+#define SERVE_BUF_SIZE 4096
+#define SERVE_MAX_LINE 8192  // longest accepted token line
+
+// Minimal single-threaded wrapper over the raw ring mmaps. The owning
+// thread is the only submitter, so queue indices need no atomics beyond
+// the release/acquire pairing with the kernel on the shared tails.
+typedef struct {
+    int fd;
+    unsigned sq_entries, cq_entries, sq_mask, cq_mask;
+    unsigned *sq_head, *sq_tail, *sq_array;
+    unsigned *cq_head, *cq_tail;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    unsigned sq_local_tail; // producer-side tail, published on submit
+    unsigned to_submit;
+    void *sq_ring, *cq_ring;
+    size_t sq_ring_sz, cq_ring_sz;
+} serve_ring;
+
+static int serve_ring_init(serve_ring *r) {
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    r->fd = sys_io_uring_setup(SERVE_RING_ENTRIES, &p);
+    if (r->fd < 0) return -1;
+
+    r->sq_ring_sz = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    r->cq_ring_sz = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    int single = (p.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single && r->cq_ring_sz > r->sq_ring_sz) r->sq_ring_sz = r->cq_ring_sz;
+
+    r->sq_ring = mmap(NULL, r->sq_ring_sz, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQ_RING);
+    if (r->sq_ring == MAP_FAILED) goto fail;
+    r->cq_ring = single
+                     ? r->sq_ring
+                     : mmap(NULL, r->cq_ring_sz, PROT_READ | PROT_WRITE,
+                            MAP_SHARED | MAP_POPULATE, r->fd,
+                            IORING_OFF_CQ_RING);
+    if (r->cq_ring == MAP_FAILED) goto fail;
+    r->sqes = mmap(NULL, p.sq_entries * sizeof(struct io_uring_sqe),
+                   PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd,
+                   IORING_OFF_SQES);
+    if (r->sqes == MAP_FAILED) goto fail;
+
+    char *sq = r->sq_ring, *cq = r->cq_ring;
+    r->sq_entries = p.sq_entries;
+    r->cq_entries = p.cq_entries;
+    r->sq_mask = *(unsigned *)(sq + p.sq_off.ring_mask);
+    r->cq_mask = *(unsigned *)(cq + p.cq_off.ring_mask);
+    r->sq_head = (unsigned *)(sq + p.sq_off.head);
+    r->sq_tail = (unsigned *)(sq + p.sq_off.tail);
+    r->sq_array = (unsigned *)(sq + p.sq_off.array);
+    r->cq_head = (unsigned *)(cq + p.cq_off.head);
+    r->cq_tail = (unsigned *)(cq + p.cq_off.tail);
+    r->cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+    r->sq_local_tail = *r->sq_tail;
+    r->to_submit = 0;
+    return 0;
+fail:
+    close(r->fd);
+    return -1;
+}
+
+// Publish queued sqes and reap at least min_complete completions.
+static int serve_ring_submit(serve_ring *r, unsigned min_complete) {
+    __atomic_store_n(r->sq_tail, r->sq_local_tail, __ATOMIC_RELEASE);
+    unsigned n = r->to_submit;
+    r->to_submit = 0;
+    int rc;
+    do {
+        rc = sys_io_uring_enter(r->fd, n, min_complete,
+                                IORING_ENTER_GETEVENTS);
+    } while (rc < 0 && errno == EINTR);
+    return rc < 0 ? -1 : 0;
+}
+
+// Claim the next sqe, flushing the queue if it is full.
+static struct io_uring_sqe *serve_sqe(serve_ring *r) {
+    while (r->sq_local_tail - __atomic_load_n(r->sq_head, __ATOMIC_ACQUIRE) ==
+           r->sq_entries) {
+        if (serve_ring_submit(r, 0) != 0) return NULL;
+    }
+    unsigned idx = r->sq_local_tail & r->sq_mask;
+    struct io_uring_sqe *sqe = &r->sqes[idx];
+    memset(sqe, 0, sizeof(*sqe));
+    r->sq_array[idx] = idx;
+    ++r->sq_local_tail;
+    ++r->to_submit;
+    return sqe;
+}
+
+// user_data encoding: operation tag in the top bits, fd below.
+enum { UD_ACCEPT = 1, UD_RECV = 2, UD_SEND = 3 };
+
+static uint64_t serve_ud(int op, int fd) {
+    return ((uint64_t)op << 32) | (uint32_t)fd;
+}
+
+// Per-connection state: a carry buffer for the partial line at the end
+// of a receive, and two output buffers that accumulate verdicts between
+// send completions. The posted SEND points into out[out_cur]; while it
+// is in flight new verdicts append to the other buffer, so the one the
+// kernel is reading is never grown (ob_append reallocs) or rewritten.
+// Send completion swaps the buffers when the current one drains.
+typedef struct {
+    char *in;
+    size_t in_len, in_cap;
+    out_buf out[2];
+    int out_cur;       // buffer the in-flight / next send draws from
+    size_t out_sent;   // bytes of out[out_cur] already sent
+    int send_inflight;
+    int recv_done;  // multishot receive has terminated
+    int skipping;   // discarding an over-long line until its newline
+    int open;
+} serve_conn;
+
+typedef struct {
+    serve_ring ring;
+    int listen_fd;
+    verify_ctx *vc;
+    struct io_uring_buf_ring *br;
+    char *buf_base;
+    unsigned short br_tail;
+    serve_conn *conns;
+    int conn_cap;
+    int failed;
+} serve_state;
+
+// Hand a receive buffer (back) to the kernel's provided-buffer ring.
+static void serve_buf_add(serve_state *s, unsigned short bid) {
+    struct io_uring_buf *b = &s->br->bufs[s->br_tail & (SERVE_BUF_COUNT - 1)];
+    b->addr = (uint64_t)(uintptr_t)(s->buf_base + (size_t)bid * SERVE_BUF_SIZE);
+    b->len = SERVE_BUF_SIZE;
+    b->bid = bid;
+    ++s->br_tail;
+    __atomic_store_n(&s->br->tail, s->br_tail, __ATOMIC_RELEASE);
+}
+
+static int serve_bufs_init(serve_state *s) {
+    s->br = aligned_alloc(4096, SERVE_BUF_COUNT * sizeof(struct io_uring_buf));
+    s->buf_base = malloc((size_t)SERVE_BUF_COUNT * SERVE_BUF_SIZE);
+    if (!s->br || !s->buf_base) return -1;
+    memset(s->br, 0, SERVE_BUF_COUNT * sizeof(struct io_uring_buf));
+
+    struct io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (uint64_t)(uintptr_t)s->br;
+    reg.ring_entries = SERVE_BUF_COUNT;
+    reg.bgid = 0;
+    if (sys_io_uring_register(s->ring.fd, IORING_REGISTER_PBUF_RING, &reg,
+                              1) != 0) {
+        return -1;
+    }
+    s->br_tail = 0;
+    for (unsigned short i = 0; i < SERVE_BUF_COUNT; ++i) serve_buf_add(s, i);
+    return 0;
+}
+
+static serve_conn *serve_conn_get(serve_state *s, int fd) {
+    if (fd >= s->conn_cap) {
+        int cap = s->conn_cap ? s->conn_cap : 64;
+        while (fd >= cap) cap *= 2;
+        serve_conn *grown = realloc(s->conns, cap * sizeof(*grown));
+        if (!grown) return NULL;
+        memset(grown + s->conn_cap, 0,
+               (cap - s->conn_cap) * sizeof(*grown));
+        s->conns = grown;
+        s->conn_cap = cap;
+    }
+    return &s->conns[fd];
+}
+
+static void serve_post_accept(serve_state *s) {
+    struct io_uring_sqe *sqe = serve_sqe(&s->ring);
+    if (!sqe) { s->failed = 1; return; }
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = s->listen_fd;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->user_data = serve_ud(UD_ACCEPT, s->listen_fd);
+}
+
+static void serve_post_recv(serve_state *s, int fd) {
+    struct io_uring_sqe *sqe = serve_sqe(&s->ring);
+    if (!sqe) { s->failed = 1; return; }
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = fd;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = 0;
+    sqe->user_data = serve_ud(UD_RECV, fd);
+}
+
+static void serve_post_send(serve_state *s, int fd, serve_conn *c) {
+    struct io_uring_sqe *sqe = serve_sqe(&s->ring);
+    if (!sqe) { s->failed = 1; return; }
+    sqe->opcode = IORING_OP_SEND;
+    sqe->fd = fd;
+    sqe->addr = (uint64_t)(uintptr_t)(c->out[c->out_cur].data + c->out_sent);
+    sqe->len = c->out[c->out_cur].len - c->out_sent;
+    sqe->msg_flags = MSG_NOSIGNAL;
+    sqe->user_data = serve_ud(UD_SEND, fd);
+    c->send_inflight = 1;
+}
+
+static void serve_conn_close(serve_state *s, int fd, serve_conn *c) {
+    if (!c->open) return;
+    c->open = 0;
+    close(fd);
+    free(c->in);
+    free(c->out[0].data);
+    free(c->out[1].data);
+    memset(c, 0, sizeof(*c));
+}
+
+// Close once both directions are finished: the multishot receive has
+// terminated and no verdict bytes remain queued or in flight.
+static void serve_conn_try_close(serve_state *s, int fd, serve_conn *c) {
+    if (c->recv_done && !c->send_inflight) serve_conn_close(s, fd, c);
+}
+
+static void serve_verdict(serve_conn *c, int res) {
+    static const char *verdict_line[] = { "MALFORMED\n", "INVALID\n",
+                                          "VALID\n" };
+    const char *line = verdict_line[res + 1];
+    // never touch the buffer a posted SEND is reading from
+    int b = c->send_inflight ? c->out_cur ^ 1 : c->out_cur;
+    ob_append(&c->out[b], line, strlen(line));
+}
+
+// Run every complete line in [data,data+len) through the verifier,
+// carrying a partial trailing line (and the tail carried from earlier
+// receives) in the connection buffer.
+static void serve_process(serve_state *s, serve_conn *c, const char *data,
+                          size_t len) {
+    size_t pos = 0;
+    while (pos < len) {
+        const char *nl = memchr(data + pos, '\n', len - pos);
+        size_t take = nl ? (size_t)(nl - (data + pos)) : len - pos;
+
+        if (c->skipping || c->in_len + take > SERVE_MAX_LINE) {
+            c->in_len = 0;
+            if (nl) {
+                metrics_count_verdict(-1);
+                serve_verdict(c, -1);
+                c->skipping = 0;
+                pos += take + 1;
+                continue;
+            }
+            c->skipping = 1;
+            return;
+        }
+
+        if (!nl) {
+            // partial tail: carry it for the next receive
+            if (c->in_len + take > c->in_cap) {
+                size_t cap = c->in_cap ? c->in_cap * 2 : 1024;
+                while (cap < c->in_len + take) cap *= 2;
+                char *grown = realloc(c->in, cap);
+                if (!grown) { c->skipping = 1; return; }
+                c->in = grown;
+                c->in_cap = cap;
+            }
+            memcpy(c->in + c->in_len, data + pos, take);
+            c->in_len += take;
+            return;
+        }
+
+        const char *line = data + pos;
+        size_t line_len = take;
+        if (c->in_len) {
+            // stitch the carried prefix onto this line
+            if (c->in_len + take > c->in_cap) {
+                size_t cap = c->in_cap ? c->in_cap * 2 : 1024;
+                while (cap < c->in_len + take) cap *= 2;
+                char *grown = realloc(c->in, cap);
+                if (!grown) { c->skipping = 1; return; }
+                c->in = grown;
+                c->in_cap = cap;
+            }
+            memcpy(c->in + c->in_len, data + pos, take);
+            line = c->in;
+            line_len = c->in_len + take;
+            c->in_len = 0;
+        }
+        while (line_len > 0 && line[line_len - 1] == '\r') --line_len;
+        if (line_len > 0) {
+            int res = verify_token_ctx(s->vc, line, line_len);
+            metrics_count_verdict(res);
+            serve_verdict(c, res);
+        }
+        pos += take + 1;
+    }
+}
+
+static void serve_handle_cqe(serve_state *s, struct io_uring_cqe *cqe) {
+    int op = (int)(cqe->user_data >> 32);
+    int fd = (int)(uint32_t)cqe->user_data;
+
+    if (op == UD_ACCEPT) {
+        if (!(cqe->flags & IORING_CQE_F_MORE)) serve_post_accept(s);
+        if (cqe->res < 0) return;
+        serve_conn *c = serve_conn_get(s, cqe->res);
+        if (!c) { close(cqe->res); return; }
+        c->open = 1;
+        serve_post_recv(s, cqe->res);
+        return;
+    }
+
+    serve_conn *c = &s->conns[fd];
+    if (!c->open) return;
+
+    if (op == UD_RECV) {
+        if (cqe->res == -ENOBUFS) {
+            // all buffers were in flight; they recycle as cqes drain
+            serve_post_recv(s, fd);
+            return;
+        }
+        if (cqe->res <= 0) {
+            c->recv_done = 1;
+            serve_conn_try_close(s, fd, c);
+            return;
+        }
+        unsigned short bid =
+            (unsigned short)(cqe->flags >> IORING_CQE_BUFFER_SHIFT);
+        serve_process(s, c, s->buf_base + (size_t)bid * SERVE_BUF_SIZE,
+                      (size_t)cqe->res);
+        serve_buf_add(s, bid);
+        if (!(cqe->flags & IORING_CQE_F_MORE)) serve_post_recv(s, fd);
+        if (c->out[c->out_cur].len > c->out_sent && !c->send_inflight) {
+            serve_post_send(s, fd, c);
+        }
+        return;
+    }
+
+    // UD_SEND
+    c->send_inflight = 0;
+    if (cqe->res <= 0) {
+        c->recv_done = 1;
+        serve_conn_close(s, fd, c);
+        return;
+    }
+    c->out_sent += (size_t)cqe->res;
+    if (c->out[c->out_cur].len > c->out_sent) {
+        // short send: continue from the same buffer, which no append
+        // has touched while the send was in flight
+        serve_post_send(s, fd, c);
+    } else {
+        c->out[c->out_cur].len = 0;
+        c->out_sent = 0;
+        if (c->out[c->out_cur ^ 1].len) {
+            // verdicts accumulated in the other buffer meanwhile
+            c->out_cur ^= 1;
+            serve_post_send(s, fd, c);
+        } else {
+            serve_conn_try_close(s, fd, c);
+        }
+    }
+}
+
+typedef struct {
+    int listen_fd;
+    const hmac_engine *template_eng;
+    const hmac_sha256_padkey *hwkey;
+    const keyset *ks;
+    int failed;
+} serve_thread;
+
+static void *serve_thread_main(void *arg) {
+    serve_thread *t = arg;
+
+    // same per-thread key setup as the batch workers
+    hmac_engine eng = {0};
+    hmac_engine *ks_engines = NULL;
+    verify_ctx vc = { NULL, t->hwkey, t->ks, NULL, NULL };
+    if (!t->ks) {
+        if (hmac_engine_clone(&eng, t->template_eng) != 0) {
+            t->failed = 1;
+            return NULL;
+        }
+        vc.eng = &eng;
+    } else if (!authtools_sha_accel()) {
+        ks_engines = calloc(t->ks->cap, sizeof(*ks_engines));
+        if (!ks_engines) {
+            t->failed = 1;
+            return NULL;
+        }
+        for (uint32_t i = 0; i < t->ks->cap; ++i) {
+            if (t->ks->slots[i].kid &&
+                hmac_engine_clone(&ks_engines[i], &t->ks->slots[i].eng) != 0) {
+                t->failed = 1;
+            }
+        }
+        vc.ks_engines = ks_engines;
+    }
+
+    serve_state s;
+    memset(&s, 0, sizeof(s));
+    s.listen_fd = t->listen_fd;
+    s.vc = &vc;
+    if (t->failed || serve_ring_init(&s.ring) != 0 ||
+        serve_bufs_init(&s) != 0) {
+        t->failed = 1;
+        return NULL;
+    }
+
+    serve_post_accept(&s);
+    while (!s.failed) {
+        if (serve_ring_submit(&s.ring, 1) != 0) break;
+        unsigned head = *s.ring.cq_head;
+        unsigned tail = __atomic_load_n(s.ring.cq_tail, __ATOMIC_ACQUIRE);
+        while (head != tail) {
+            serve_handle_cqe(&s, &s.ring.cqes[head & s.ring.cq_mask]);
+            ++head;
+        }
+        __atomic_store_n(s.ring.cq_head, head, __ATOMIC_RELEASE);
+    }
+    t->failed = 1;
+    return NULL;
+}
+
+static int run_serve(const char *sock_path, const char *secret,
+                     const keyset *ks, int nthreads) {
+    hmac_engine eng = {0};
+    hmac_sha256_padkey hwkey;
+    const hmac_sha256_padkey *hwkey_p = NULL;
+    if (!ks) {
+        if (hmac_engine_init(&eng, EVP_sha256(), secret, strlen(secret)) != 0) {
+            fprintf(stderr, "HMAC init failed\n");
+            return 1;
+        }
+        if (authtools_sha_accel() &&
+            hmac_sha256_padkey_init(&hwkey, (const unsigned char *)secret,
+                                    strlen(secret)) == 0) {
+            hwkey_p = &hwkey;
+        }
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+    int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (sock < 0) {
+        perror("socket");
+        return 1;
+    }
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", sock_path);
+    unlink(sock_path);
+    if (bind(sock, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+        listen(sock, SOMAXCONN) != 0) {
+        perror("bind/listen");
+        close(sock);
+        return 1;
+    }
+
+    serve_thread *threads = calloc(nthreads, sizeof(*threads));
+    pthread_t *tids = calloc(nthreads, sizeof(*tids));
+    if (!threads || !tids) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+    for (int i = 0; i < nthreads; ++i) {
+        threads[i] = (serve_thread){ sock, ks ? NULL : &eng, hwkey_p, ks, 0 };
+        if (pthread_create(&tids[i], NULL, serve_thread_main, &threads[i]) !=
+            0) {
+            fprintf(stderr, "cannot start serve thread\n");
+            return 1;
+        }
+    }
+    for (int i = 0; i < nthreads; ++i) pthread_join(tids[i], NULL);
+    // the loop threads only return on ring failure
+    fprintf(stderr, "serve loop failed\n");
+    return 1;
+}
+
+#endif // __linux__
+
 int main(int argc, char **argv) {
-    if (argc != 3) {
-        fprintf(stderr, "Usage: %s <jwt> <secret>\n", argv[0]);
+#ifdef __linux__
+    if (argc >= 3 && strcmp(argv[1], "--serve") == 0) {
+        const char *sock_path = argv[2];
+        const char *keyset_path = NULL;
+        char *secret = NULL;
+        int nthreads = 1;
+        for (int i = 3; i < argc; ++i) {
+            if (strcmp(argv[i], "--secret-file") == 0 && i + 1 < argc) {
+                secret = load_secret_file(argv[++i]);
+                if (!secret) {
+                    fprintf(stderr, "cannot read secret file\n");
+                    return 1;
+                }
+            } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+                nthreads = atoi(argv[++i]);
+                if (nthreads < 1) {
+                    fprintf(stderr, "--threads needs a positive count\n");
+                    free(secret);
+                    return 1;
+                }
+            } else if (strcmp(argv[i], "--keyset") == 0 && i + 1 < argc) {
+                keyset_path = argv[++i];
+            } else if (strcmp(argv[i], "--metrics") == 0 && i + 1 < argc) {
+                metrics_seg = metrics_map(argv[++i], 1);
+                if (!metrics_seg) {
+                    fprintf(stderr, "cannot map metrics segment %s\n",
+                            argv[i]);
+                    free(secret);
+                    return 1;
+                }
+            } else {
+                fprintf(stderr, "unknown serve option %s\n", argv[i]);
+                free(secret);
+                return 1;
+            }
+        }
+        keyset ks = {0};
+        if (keyset_path) {
+            if (keyset_load(keyset_path, &ks) != 0) {
+                fprintf(stderr, "cannot load keyset from %s\n", keyset_path);
+                free(secret);
+                return 1;
+            }
+        } else if (!secret) {
+            const char *env = getenv("JWT_SECRET");
+            if (!env || !*env) {
+                fprintf(stderr, "serve mode needs --keyset, --secret-file or "
+                                "JWT_SECRET\n");
+                return 1;
+            }
+            secret = strdup(env);
+        }
+        int rc = run_serve(sock_path, secret, keyset_path ? &ks : NULL,
+                           nthreads);
+        free(secret);
+        return rc;
+    }
+#endif
+
+    if (argc >= 2 && strcmp(argv[1], "--batch") == 0) {
+        const char *tokens_path = NULL;
+        const char *mmap_path = NULL;
+        const char *keyset_path = NULL;
+        const char *ed_path = NULL;
+        char *secret = NULL;
+        int nthreads = 1;
+        int want_dedup = 0;
+        int want_numa = 0;
+        claim_spec claims;
+        int have_claims = 0;
+        for (int i = 2; i < argc; ++i) {
+            if (strcmp(argv[i], "--secret-file") == 0 && i + 1 < argc) {
+                secret = load_secret_file(argv[++i]);
+                if (!secret) {
+                    fprintf(stderr, "cannot read secret file\n");
+                    return 1;
+                }
+            } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+                nthreads = atoi(argv[++i]);
+                if (nthreads < 1) {
+                    fprintf(stderr, "--threads needs a positive count\n");
+                    free(secret);
+                    return 1;
+                }
+            } else if (strcmp(argv[i], "--mmap") == 0 && i + 1 < argc) {
+                mmap_path = argv[++i];
+            } else if (strcmp(argv[i], "--keyset") == 0 && i + 1 < argc) {
+                keyset_path = argv[++i];
+            } else if (strcmp(argv[i], "--ed25519") == 0 && i + 1 < argc) {
+                ed_path = argv[++i];
+            } else if (strcmp(argv[i], "--dedup") == 0) {
+                want_dedup = 1;
+            } else if (strcmp(argv[i], "--numa") == 0) {
+                want_numa = 1;
+            } else if (strcmp(argv[i], "--stats") == 0) {
+                stats_enabled = 1;
+            } else if (strcmp(argv[i], "--metrics") == 0 && i + 1 < argc) {
+                metrics_seg = metrics_map(argv[++i], 1);
+                if (!metrics_seg) {
+                    fprintf(stderr, "cannot map metrics segment %s\n",
+                            argv[i]);
+                    free(secret);
+                    return 1;
+                }
+            } else if (strcmp(argv[i], "--output-format") == 0 &&
+                       i + 1 < argc) {
+                const char *fmt = argv[++i];
+                if (strcmp(fmt, "binary") == 0) {
+                    binary_out = 1;
+                } else if (strcmp(fmt, "text") != 0) {
+                    fprintf(stderr, "bad --output-format %s "
+                                    "(text or binary)\n", fmt);
+                    free(secret);
+                    return 1;
+                }
+            } else if (strcmp(argv[i], "--claims") == 0 && i + 1 < argc) {
+                if (parse_claim_spec(argv[++i], &claims) != 0) {
+                    fprintf(stderr, "bad --claims list\n");
+                    free(secret);
+                    return 1;
+                }
+                have_claims = 1;
+            } else {
+                tokens_path = argv[i];
+            }
+        }
+        if (binary_out && have_claims) {
+            // records hold exp only; arbitrary claim columns stay text
+            fprintf(stderr, "--output-format binary and --claims are "
+                            "exclusive\n");
+            free(secret);
+            return 1;
+        }
+        keyset ks = {0};
+        ed25519_key ed = {{0}};
+        if (ed_path) {
+            if (keyset_path) {
+                fprintf(stderr, "--ed25519 and --keyset are exclusive\n");
+                free(secret);
+                return 1;
+            }
+            if (ed25519_key_load(ed_path, &ed) != 0) {
+                fprintf(stderr, "cannot load Ed25519 public key from %s\n",
+                        ed_path);
+                free(secret);
+                return 1;
+            }
+            stat_stage_names[ST_MAC] = "ed25519";
+        } else if (keyset_path) {
+            if (keyset_load(keyset_path, &ks) != 0) {
+                fprintf(stderr, "cannot load keyset from %s\n", keyset_path);
+                free(secret);
+                return 1;
+            }
+        } else if (!secret) {
+            const char *env = getenv("JWT_SECRET");
+            if (!env || !*env) {
+                fprintf(stderr, "batch mode needs --keyset, --ed25519, "
+                                "--secret-file or JWT_SECRET\n");
+                return 1;
+            }
+            secret = strdup(env);
+        }
+        const keyset *ks_p = keyset_path ? &ks : NULL;
+        const ed25519_key *ed_p = ed_path ? &ed : NULL;
+        if (want_numa) {
+            if (numa_topo_load(&numa_topology) == 0) {
+                numa_nodes = calloc(numa_topology.nnodes,
+                                    sizeof(*numa_nodes));
+                numa_active = numa_nodes != NULL;
+            }
+            if (!numa_active) {
+                fprintf(stderr, "warning: NUMA topology unavailable, "
+                                "running unplaced\n");
+            }
+        }
+        dedup_cache dedup = {0};
+        if (want_dedup && !numa_active && dedup_init(&dedup) != 0) {
+            fprintf(stderr, "out of memory for dedup cache\n");
+            free(secret);
+            return 1;
+        }
+        // under --numa the per-node shards are created lazily by the first
+        // worker on each node; the flag itself still travels as a non-NULL
+        // pointer so workers know dedup was requested
+        dedup_cache *dedup_p = want_dedup ? &dedup : NULL;
+
+        if (binary_out) {
+            uint64_t magic = VOUT_MAGIC;
+            if (write(STDOUT_FILENO, &magic, sizeof(magic)) !=
+                (ssize_t)sizeof(magic)) {
+                fprintf(stderr, "cannot write stream header\n");
+                free(dedup.slots);
+                free(secret);
+                return 1;
+            }
+        }
+
+        int rc;
+        if (mmap_path) {
+            // map the dump read-only and scan tokens in place: no copy of
+            // the file contents is ever made
+            int fd = open(mmap_path, O_RDONLY);
+            struct stat st;
+            if (fd < 0 || fstat(fd, &st) != 0) {
+                fprintf(stderr, "cannot open %s\n", mmap_path);
+                if (fd >= 0) close(fd);
+                free(secret);
+                return 1;
+            }
+            char *map = NULL;
+            if (st.st_size > 0) {
+                map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+                if (map == MAP_FAILED) {
+                    fprintf(stderr, "mmap failed for %s\n", mmap_path);
+                    close(fd);
+                    free(secret);
+                    return 1;
+                }
+                madvise(map, st.st_size, MADV_SEQUENTIAL);
+            }
+            rc = run_batch(map, st.st_size, secret, ks_p, dedup_p, ed_p,
+                           nthreads, have_claims ? &claims : NULL);
+            if (map) munmap(map, st.st_size);
+            close(fd);
+        } else {
+            FILE *in = stdin;
+            if (tokens_path) {
+                in = fopen(tokens_path, "r");
+                if (!in) {
+                    fprintf(stderr, "cannot open %s\n", tokens_path);
+                    free(secret);
+                    return 1;
+                }
+            }
+            rc = run_batch_stream(in, secret, ks_p, dedup_p, ed_p, nthreads,
+                                  have_claims ? &claims : NULL);
+            if (in != stdin) fclose(in);
+        }
+        if (stats_enabled) {
+            stat_report(stat_stage_names, stats_total, ST_STAGES);
+        }
+        free(dedup.slots);
+        free(secret);
+        return rc;
+    }
+
+    // single-token EdDSA: --ed25519 <pub.pem> <jwt>
+    const char *ed_pub_path = NULL;
+    if (argc == 4 && strcmp(argv[1], "--ed25519") == 0) {
+        ed_pub_path = argv[2];
+        argv[1] = argv[3];
+        argc = 3;
+    }
+
+    if (argc != 3 && !(ed_pub_path && argc == 3)) {
+        fprintf(stderr,
+                "Usage:\n  %s <jwt> <secret>\n"
+                "  %s --ed25519 <pubkey.pem> <jwt>\n"
+                "  %s --batch [tokens-file] (--keyset <file> | --ed25519 "
+                "<pubkey.pem> | --secret-file <path> | JWT_SECRET env)\n"
+                "  %s --serve <socket-path> [--threads N]\n",
+                argv[0], argv[0], argv[0], argv[0]);
         return 1;
     }
     char *jwt = argv[1];
-    char *secret = argv[2];
+    char *secret = ed_pub_path ? NULL : argv[2];
 
     // split parts
     char *dot1 = strchr(jwt, '.');
@@ -63,7 +2418,6 @@ int main(int argc, char **argv) {
 
     size_t header_len = dot1 - jwt;
     size_t payload_len = dot2 - dot1 -1;
-    size_t sig_len = strlen(dot2 +1);
 
     char *header_b64 = strndup(jwt, header_len);
     char *payload_b64 = strndup(dot1 +1, payload_len);
@@ -75,23 +2429,46 @@ int main(int argc, char **argv) {
     snprintf(signing_input, signing_input_len +1, "%s.%s", header_b64, payload_b64);
 
     // decode signature
-    size_t sig_dec_len;
-    unsigned char *sig_dec = b64url_decode(sig_b64, &sig_dec_len);
-
-    // compute HMAC SHA256
-    unsigned int result_len;
-    unsigned char *hmac = HMAC(EVP_sha256(), secret, strlen(secret),
-                               (unsigned char *)signing_input, strlen(signing_input),
-                               NULL, &result_len);
-    if (!hmac) {
-        fprintf(stderr, "HMAC failed\n");
-        return 1;
-    }
+    unsigned char sig_dec[EVP_MAX_MD_SIZE];
+    size_t sig_dec_len = 0;
+    int sig_ok = b64url_decode_buf(sig_b64, strlen(sig_b64), sig_dec,
+                                   sizeof(sig_dec), &sig_dec_len) == 0;
 
     int valid = 0;
-    if (sig_dec && result_len == sig_dec_len) {
-        if (constant_time_cmp(hmac, sig_dec, result_len)) {
-            valid = 1;
+    if (ed_pub_path) {
+        ed25519_key edk;
+        ed25519_verifier edv;
+        if (ed25519_key_load(ed_pub_path, &edk) != 0) {
+            fprintf(stderr, "cannot load Ed25519 public key from %s\n",
+                    ed_pub_path);
+            return 1;
+        }
+        if (ed25519_verifier_init(&edv, &edk) != 0) {
+            fprintf(stderr, "Ed25519 init failed\n");
+            return 1;
+        }
+        valid = sig_ok && sig_dec_len == 64 &&
+                ed25519_verify(&edv, sig_dec,
+                               (const unsigned char *)signing_input,
+                               strlen(signing_input));
+        ed25519_verifier_free(&edv);
+    } else {
+        // compute HMAC SHA256
+        hmac_engine eng;
+        unsigned char hmac[EVP_MAX_MD_SIZE];
+        unsigned int result_len;
+        if (hmac_engine_init(&eng, EVP_sha256(), secret, strlen(secret)) != 0 ||
+            hmac_engine_mac(&eng, (unsigned char *)signing_input,
+                            strlen(signing_input), hmac, &result_len) != 0) {
+            fprintf(stderr, "HMAC failed\n");
+            return 1;
+        }
+        hmac_engine_free(&eng);
+
+        if (sig_ok && result_len == sig_dec_len) {
+            if (constant_time_cmp(hmac, sig_dec, result_len)) {
+                valid = 1;
+            }
         }
     }
 
@@ -102,17 +2479,18 @@ int main(int argc, char **argv) {
     printf("Signature: VALID\n");
 
     // decode payload
+    size_t pl_cap = payload_len / 4 * 3 + 3;
+    unsigned char *pl_dec = malloc(pl_cap);
     size_t pl_dec_len;
-    unsigned char *pl_dec = b64url_decode(payload_b64, &pl_dec_len);
-    if (pl_dec) {
+    if (pl_dec &&
+        b64url_decode_buf(payload_b64, payload_len, pl_dec, pl_cap, &pl_dec_len) == 0) {
         printf("Payload: %.*s\n", (int)pl_dec_len, pl_dec);
-        free(pl_dec);
     }
+    free(pl_dec);
 
     free(header_b64);
     free(payload_b64);
     free(sig_b64);
     free(signing_input);
-    if (sig_dec) free(sig_dec);
     return 0;
 }
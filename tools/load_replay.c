@@ -0,0 +1,392 @@
+// Load-replay generator for captured auth traffic. Replays a capture of
+// newline-delimited requests (requests.jsonl-shaped, or any line
+// protocol the sidecars speak) against a Unix or TCP endpoint at a
+// target rate, and reports latency percentiles.
+// Build with: make tools
+// Usage:
+//   ./load_replay <capture> (--unix <socket> | --connect <host> <port>)
+//                 [--rate N] [--conns N] [--count N]
+//
+// The capture is mmap'd and pre-parsed into a compact binary schedule
+// (<capture>.sched: one offset/length/timestamp record per request)
+// the first time it is seen; later runs mmap the schedule and skip the
+// text scan entirely. Lines carrying a numeric "ts" JSON field keep
+// their relative timing in the schedule. Replay runs an epoll loop over
+// keep-alive connections: a token-bucket pacer admits requests at
+// --rate, each connection pipelines its in-flight requests and matches
+// response lines to send timestamps in FIFO order, and the collected
+// latencies print as a p50/p90/p99/p999 table in the bench_tools style.
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <time.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <signal.h>
+
+// ---- binary schedule cache ----
+//
+// Fixed-layout records so a later run can mmap the file and replay with
+// no parsing. The header pins the source capture's size and mtime; a
+// mismatch regenerates the schedule.
+
+#define SCHED_MAGIC 0x64656863734c5241ull // "ARLsched"
+
+typedef struct {
+    uint64_t magic;
+    uint64_t count;
+    uint64_t src_size;
+    uint64_t src_mtime;
+} sched_header;
+
+typedef struct {
+    uint64_t offset; // byte offset of the line in the capture
+    uint32_t len;    // line length, without the newline
+    uint32_t pad;
+    uint64_t ts_ns;  // capture-relative timestamp, 0 when absent
+} sched_rec;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// Pull a numeric "ts" field (seconds, fractional allowed) out of a JSON
+// line without building a document; returns 0 when absent.
+static uint64_t line_ts_ns(const char *line, size_t len) {
+    static const char key[] = "\"ts\"";
+    const char *p = memmem(line, len, key, sizeof(key) - 1);
+    if (!p) return 0;
+    p += sizeof(key) - 1;
+    const char *end = line + len;
+    while (p < end && (*p == ':' || *p == ' ')) ++p;
+    char buf[32];
+    size_t n = 0;
+    while (p < end && n < sizeof(buf) - 1 &&
+           ((*p >= '0' && *p <= '9') || *p == '.')) {
+        buf[n++] = *p++;
+    }
+    buf[n] = '\0';
+    return n ? (uint64_t)(strtod(buf, NULL) * 1e9) : 0;
+}
+
+// Scan the capture into schedule records and write the cache file.
+static int sched_build(const char *map, size_t size, const char *sched_path,
+                       const struct stat *src_st) {
+    FILE *out = fopen(sched_path, "w");
+    if (!out) return -1;
+    sched_header hdr = { SCHED_MAGIC, 0, (uint64_t)src_st->st_size,
+                         (uint64_t)src_st->st_mtime };
+    fwrite(&hdr, sizeof(hdr), 1, out); // count backpatched below
+
+    uint64_t first_ts = 0, count = 0;
+    size_t start = 0;
+    for (size_t i = 0; i <= size; ++i) {
+        if (i != size && map[i] != '\n') continue;
+        size_t len = i - start;
+        while (len > 0 && map[start + len - 1] == '\r') --len;
+        if (len > 0) {
+            uint64_t ts = line_ts_ns(map + start, len);
+            if (ts && !first_ts) first_ts = ts;
+            sched_rec rec = { start, (uint32_t)len, 0,
+                              ts >= first_ts ? ts - first_ts : 0 };
+            fwrite(&rec, sizeof(rec), 1, out);
+            ++count;
+        }
+        start = i + 1;
+    }
+    hdr.count = count;
+    rewind(out);
+    fwrite(&hdr, sizeof(hdr), 1, out);
+    return fclose(out) == 0 ? 0 : -1;
+}
+
+// mmap the schedule, (re)building it when missing or stale. Returns the
+// record array and count, or NULL.
+static const sched_rec *sched_load(const char *capture_path, const char *map,
+                                   size_t size, const struct stat *src_st,
+                                   uint64_t *count_out) {
+    char sched_path[4096];
+    snprintf(sched_path, sizeof(sched_path), "%s.sched", capture_path);
+
+    for (int attempt = 0; attempt < 2; ++attempt) {
+        int fd = open(sched_path, O_RDONLY);
+        if (fd >= 0) {
+            struct stat st;
+            if (fstat(fd, &st) == 0 &&
+                (size_t)st.st_size >= sizeof(sched_header)) {
+                void *m = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+                close(fd);
+                if (m != MAP_FAILED) {
+                    const sched_header *hdr = m;
+                    if (hdr->magic == SCHED_MAGIC &&
+                        hdr->src_size == (uint64_t)src_st->st_size &&
+                        hdr->src_mtime == (uint64_t)src_st->st_mtime &&
+                        (size_t)st.st_size >= sizeof(sched_header) +
+                                                  hdr->count * sizeof(sched_rec)) {
+                        *count_out = hdr->count;
+                        return (const sched_rec *)(hdr + 1);
+                    }
+                    munmap(m, st.st_size);
+                }
+            } else {
+                close(fd);
+            }
+        }
+        if (attempt == 0 &&
+            sched_build(map, size, sched_path, src_st) != 0) {
+            return NULL;
+        }
+    }
+    return NULL;
+}
+
+// ---- replay engine ----
+
+#define REPLAY_MAX_CONNS 256
+#define REPLAY_PIPELINE 64     // per-connection in-flight request cap
+#define REPLAY_READ_CHUNK 65536
+
+// One keep-alive connection: a FIFO of send timestamps for the requests
+// currently in flight. Responses arrive in order per connection, so a
+// newline in the read stream always completes the oldest entry.
+typedef struct {
+    int fd;
+    uint64_t sent_ns[REPLAY_PIPELINE];
+    uint32_t fifo_head, fifo_tail; // indices mod REPLAY_PIPELINE
+} replay_conn;
+
+static uint32_t conn_inflight(const replay_conn *c) {
+    return c->fifo_tail - c->fifo_head;
+}
+
+static int replay_connect_unix(const char *path) {
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", path);
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static int replay_connect_tcp(const char *host, const char *port) {
+    struct addrinfo hints, *res;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_socktype = SOCK_STREAM;
+    if (getaddrinfo(host, port, &hints, &res) != 0) return -1;
+    int fd = -1;
+    for (struct addrinfo *ai = res; ai; ai = ai->ai_next) {
+        fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (fd < 0) continue;
+        if (connect(fd, ai->ai_addr, ai->ai_addrlen) == 0) break;
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(res);
+    return fd;
+}
+
+static int cmp_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y ? 1 : 0;
+}
+
+static void replay_report(uint64_t *lat, size_t n, uint64_t wall_ns) {
+    if (n == 0) {
+        printf("no responses\n");
+        return;
+    }
+    qsort(lat, n, sizeof(*lat), cmp_u64);
+    double secs = wall_ns / 1e9;
+    printf("%zu requests in %.2fs  %.0f req/sec\n", n, secs, n / secs);
+    printf("latency  p50 %7.1f us  p90 %7.1f us  p99 %7.1f us  "
+           "p999 %7.1f us  max %7.1f us\n",
+           lat[n / 2] / 1e3, lat[n - 1 - n / 10] / 1e3,
+           lat[n - 1 - n / 100] / 1e3, lat[n - 1 - n / 1000] / 1e3,
+           lat[n - 1] / 1e3);
+}
+
+// Drain response lines, closing out one in-flight request per line.
+static int replay_read(replay_conn *c, uint64_t *lat, size_t *lat_count) {
+    char buf[REPLAY_READ_CHUNK];
+    for (;;) {
+        ssize_t n = recv(c->fd, buf, sizeof(buf), MSG_DONTWAIT);
+        if (n < 0) return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
+        if (n == 0) return -1;
+        uint64_t t = now_ns();
+        for (ssize_t i = 0; i < n; ++i) {
+            if (buf[i] != '\n') continue;
+            if (conn_inflight(c) == 0) return -1; // unsolicited response
+            uint64_t sent = c->sent_ns[c->fifo_head % REPLAY_PIPELINE];
+            ++c->fifo_head;
+            lat[(*lat_count)++] = t - sent;
+        }
+        if (n < (ssize_t)sizeof(buf)) return 0;
+    }
+}
+
+static int run_replay(const char *map, const sched_rec *recs, uint64_t total,
+                      const char *unix_path, const char *host,
+                      const char *port, double rate, int nconns,
+                      uint64_t count) {
+    if (count == 0 || count > total) count = total;
+    if (nconns < 1) nconns = 1;
+    if (nconns > REPLAY_MAX_CONNS) nconns = REPLAY_MAX_CONNS;
+
+    signal(SIGPIPE, SIG_IGN);
+    replay_conn conns[REPLAY_MAX_CONNS];
+    memset(conns, 0, sizeof(conns[0]) * nconns);
+    int epfd = epoll_create1(0);
+    if (epfd < 0) {
+        perror("epoll_create1");
+        return 1;
+    }
+    for (int i = 0; i < nconns; ++i) {
+        int fd = unix_path ? replay_connect_unix(unix_path)
+                           : replay_connect_tcp(host, port);
+        if (fd < 0) {
+            fprintf(stderr, "cannot connect (%d of %d)\n", i + 1, nconns);
+            return 1;
+        }
+        conns[i].fd = fd;
+        struct epoll_event ev = { EPOLLIN, { .u32 = (uint32_t)i } };
+        if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) != 0) {
+            perror("epoll_ctl");
+            return 1;
+        }
+    }
+
+    uint64_t *lat = malloc(count * sizeof(*lat));
+    if (!lat) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+    size_t lat_count = 0;
+
+    // token bucket: `rate` tokens/s, one token per request, a burst of
+    // rate/100 (>=1) so a stall never causes a thundering catch-up
+    double tokens = 0;
+    double burst = rate / 100 > 1 ? rate / 100 : 1;
+    uint64_t start = now_ns(), last_refill = start;
+
+    uint64_t sent = 0;
+    int next_conn = 0, failed = 0;
+    while (lat_count < count && !failed) {
+        uint64_t t = now_ns();
+        tokens += (t - last_refill) * rate / 1e9;
+        if (tokens > burst) tokens = burst;
+        last_refill = t;
+
+        // admit paced requests onto the least-loaded connections
+        while (sent < count && tokens >= 1) {
+            replay_conn *c = &conns[next_conn];
+            next_conn = (next_conn + 1) % nconns;
+            if (conn_inflight(c) >= REPLAY_PIPELINE) break;
+            const sched_rec *r = &recs[sent];
+            struct iovec iov[2] = { { (void *)(map + r->offset), r->len },
+                                    { (void *)"\n", 1 } };
+            if (writev(c->fd, iov, 2) != (ssize_t)r->len + 1) {
+                failed = 1;
+                break;
+            }
+            c->sent_ns[c->fifo_tail % REPLAY_PIPELINE] = now_ns();
+            ++c->fifo_tail;
+            tokens -= 1;
+            ++sent;
+        }
+
+        struct epoll_event evs[REPLAY_MAX_CONNS];
+        int timeout = sent < count ? 1 : 100;
+        int nev = epoll_wait(epfd, evs, nconns, timeout);
+        for (int e = 0; e < nev; ++e) {
+            replay_conn *c = &conns[evs[e].data.u32];
+            if (replay_read(c, lat, &lat_count) != 0) {
+                fprintf(stderr, "connection dropped\n");
+                failed = 1;
+            }
+        }
+        if (now_ns() - start > (uint64_t)30e9 && lat_count == 0) {
+            fprintf(stderr, "no responses after 30s, giving up\n");
+            failed = 1;
+        }
+    }
+
+    replay_report(lat, lat_count, now_ns() - start);
+    free(lat);
+    for (int i = 0; i < nconns; ++i) close(conns[i].fd);
+    close(epfd);
+    return failed ? 1 : 0;
+}
+
+int main(int argc, char **argv) {
+    const char *capture = NULL, *unix_path = NULL;
+    const char *host = NULL, *port = NULL;
+    double rate = 10000;
+    int nconns = 4;
+    uint64_t count = 0;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--unix") == 0 && i + 1 < argc) {
+            unix_path = argv[++i];
+        } else if (strcmp(argv[i], "--connect") == 0 && i + 2 < argc) {
+            host = argv[++i];
+            port = argv[++i];
+        } else if (strcmp(argv[i], "--rate") == 0 && i + 1 < argc) {
+            rate = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--conns") == 0 && i + 1 < argc) {
+            nconns = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--count") == 0 && i + 1 < argc) {
+            count = strtoull(argv[++i], NULL, 10);
+        } else {
+            capture = argv[i];
+        }
+    }
+    if (!capture || (!unix_path && !host) || rate <= 0) {
+        fprintf(stderr,
+                "Usage:\n  %s <capture> (--unix <socket> | --connect <host> "
+                "<port>)\n                [--rate N] [--conns N] [--count N]\n",
+                argv[0]);
+        return 1;
+    }
+
+    int fd = open(capture, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0 || st.st_size == 0) {
+        fprintf(stderr, "cannot open %s\n", capture);
+        if (fd >= 0) close(fd);
+        return 1;
+    }
+    char *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED) {
+        fprintf(stderr, "mmap failed for %s\n", capture);
+        close(fd);
+        return 1;
+    }
+
+    uint64_t total = 0;
+    const sched_rec *recs = sched_load(capture, map, st.st_size, &st, &total);
+    if (!recs || total == 0) {
+        fprintf(stderr, "cannot build schedule for %s\n", capture);
+        return 1;
+    }
+
+    return run_replay(map, recs, total, unix_path, host, port, rate, nconns,
+                      count);
+}
@@ -0,0 +1,184 @@
+// Prometheus exporter for the tools' shared-memory metrics segments.
+// Build with: make tools
+// Usage:
+//   ./metrics_export <port> <shm-name> [<shm-name> ...]
+//
+// Maps each named segment (as written by jwt_verify --metrics or
+// totp_tool --metrics) read-only and serves one text-format exposition
+// per HTTP request on the given TCP port. Each segment becomes a
+// "segment" label so one exporter can cover several daemons. The
+// exporter only reads: all counters are updated by the tools with
+// relaxed atomic adds, so a scrape is a consistent-enough snapshot
+// without any coordination.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <signal.h>
+
+#include "authtools.h"
+
+#define MAX_SEGMENTS 16
+
+static const char *const verdict_names[3] = { "valid", "invalid",
+                                              "malformed" };
+
+typedef struct {
+    char *data;
+    size_t len, cap;
+} text_buf;
+
+static void tb_printf(text_buf *tb, const char *fmt, ...)
+    __attribute__((format(printf, 2, 3)));
+
+static void tb_printf(text_buf *tb, const char *fmt, ...) {
+    va_list ap;
+    for (;;) {
+        va_start(ap, fmt);
+        int n = vsnprintf(tb->data + tb->len, tb->cap - tb->len, fmt, ap);
+        va_end(ap);
+        if (n < 0) return;
+        if (tb->len + (size_t)n < tb->cap) {
+            tb->len += (size_t)n;
+            return;
+        }
+        size_t cap = tb->cap ? tb->cap * 2 : 1 << 16;
+        while (tb->len + (size_t)n >= cap) cap *= 2;
+        char *grown = realloc(tb->data, cap);
+        if (!grown) return;
+        tb->data = grown;
+        tb->cap = cap;
+    }
+}
+
+// Render every segment's counters as one exposition. Counter reads are
+// relaxed loads; Prometheus tolerates slight skew between them.
+static void render(text_buf *tb, const char *const names[],
+                   metrics_segment *const segs[], int nsegs) {
+    tb->len = 0;
+    tb_printf(tb, "# TYPE authtools_verifications_total counter\n");
+    for (int s = 0; s < nsegs; ++s) {
+        for (int v = 0; v < 3; ++v) {
+            tb_printf(tb,
+                      "authtools_verifications_total"
+                      "{segment=\"%s\",verdict=\"%s\"} %llu\n",
+                      names[s], verdict_names[v],
+                      (unsigned long long)__atomic_load_n(
+                          &segs[s]->verdicts[v], __ATOMIC_RELAXED));
+        }
+    }
+    tb_printf(tb, "# TYPE authtools_dedup_lookups_total counter\n");
+    tb_printf(tb, "# TYPE authtools_dedup_hits_total counter\n");
+    for (int s = 0; s < nsegs; ++s) {
+        tb_printf(tb, "authtools_dedup_lookups_total{segment=\"%s\"} %llu\n",
+                  names[s],
+                  (unsigned long long)__atomic_load_n(&segs[s]->dedup_lookups,
+                                                      __ATOMIC_RELAXED));
+        tb_printf(tb, "authtools_dedup_hits_total{segment=\"%s\"} %llu\n",
+                  names[s],
+                  (unsigned long long)__atomic_load_n(&segs[s]->dedup_hits,
+                                                      __ATOMIC_RELAXED));
+    }
+    tb_printf(tb, "# TYPE authtools_stage_cycles histogram\n");
+    for (int s = 0; s < nsegs; ++s) {
+        for (int st = 0; st < METRICS_STAGES; ++st) {
+            uint64_t cum = 0;
+            for (int b = 0; b < METRICS_BUCKETS; ++b) {
+                cum += __atomic_load_n(&segs[s]->stage_hist[st][b],
+                                       __ATOMIC_RELAXED);
+                // bucket b holds observations in [2^b, 2^(b+1))
+                tb_printf(tb,
+                          "authtools_stage_cycles_bucket{segment=\"%s\","
+                          "stage=\"%s\",le=\"%llu\"} %llu\n",
+                          names[s], metrics_stage_names[st],
+                          (unsigned long long)(2ull << b),
+                          (unsigned long long)cum);
+            }
+            tb_printf(tb,
+                      "authtools_stage_cycles_bucket{segment=\"%s\","
+                      "stage=\"%s\",le=\"+Inf\"} %llu\n",
+                      names[s], metrics_stage_names[st],
+                      (unsigned long long)cum);
+            tb_printf(tb,
+                      "authtools_stage_cycles_sum{segment=\"%s\","
+                      "stage=\"%s\"} %llu\n",
+                      names[s], metrics_stage_names[st],
+                      (unsigned long long)__atomic_load_n(
+                          &segs[s]->stage_cycles[st], __ATOMIC_RELAXED));
+            tb_printf(tb,
+                      "authtools_stage_cycles_count{segment=\"%s\","
+                      "stage=\"%s\"} %llu\n",
+                      names[s], metrics_stage_names[st],
+                      (unsigned long long)__atomic_load_n(
+                          &segs[s]->stage_ops[st], __ATOMIC_RELAXED));
+        }
+    }
+}
+
+int main(int argc, char **argv) {
+    if (argc < 3 || argc > 2 + MAX_SEGMENTS) {
+        fprintf(stderr, "Usage: %s <port> <shm-name> [<shm-name> ...]\n",
+                argv[0]);
+        return 1;
+    }
+    int port = atoi(argv[1]);
+    const char *names[MAX_SEGMENTS];
+    metrics_segment *segs[MAX_SEGMENTS];
+    int nsegs = 0;
+    for (int i = 2; i < argc; ++i) {
+        metrics_segment *m = metrics_map(argv[i], 1);
+        if (!m) {
+            fprintf(stderr, "cannot map metrics segment %s\n", argv[i]);
+            return 1;
+        }
+        // strip the leading slash from the label value
+        names[nsegs] = argv[i][0] == '/' ? argv[i] + 1 : argv[i];
+        segs[nsegs++] = m;
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+    int sock = socket(AF_INET, SOCK_STREAM, 0);
+    if (sock < 0) {
+        perror("socket");
+        return 1;
+    }
+    int one = 1;
+    setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons((uint16_t)port);
+    if (bind(sock, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+        listen(sock, 16) != 0) {
+        perror("bind/listen");
+        close(sock);
+        return 1;
+    }
+
+    text_buf tb = {0};
+    char hdr[128], req[1024];
+    for (;;) {
+        int fd = accept(sock, NULL, NULL);
+        if (fd < 0) continue;
+        // drain the request line; the response is the same for any path
+        ssize_t r = read(fd, req, sizeof(req));
+        (void)r;
+        render(&tb, names, segs, nsegs);
+        int n = snprintf(hdr, sizeof(hdr),
+                         "HTTP/1.0 200 OK\r\n"
+                         "Content-Type: text/plain; version=0.0.4\r\n"
+                         "Content-Length: %zu\r\n\r\n",
+                         tb.len);
+        if (write(fd, hdr, (size_t)n) == n) {
+            ssize_t w = write(fd, tb.data, tb.len);
+            (void)w;
+        }
+        close(fd);
+    }
+}
@@ -1,148 +1,796 @@
 // Simple TOTP generator / verifier (RFC 6238) using SHA1.
-// Build with: gcc -o totp_tool tools/totp_tool.c -lcrypto
+// Build with: make tools (thin wrapper over libauthtools)
 // Usage:
 //   ./totp_tool generate <base32-secret>
 //   ./totp_tool verify <base32-secret> <6-digit-code> [window]
+//   ./totp_tool serve <socket-path> [secrets-file] [max-mem-mib]
+//               [--metrics <shm-name>]
+//   ./totp_tool bulk-verify <triples-file> [window] [threads] [--stats]
+//   ./totp_tool pregen <secrets-file> [steps] [threads]
 //
 // Example:
 //   ./totp_tool generate JBSWY3DPEHPK3PXP
 //   ./totp_tool verify JBSWY3DPEHPK3PXP 123456 1
+//
+// bulk-verify reads "user-id,base32-secret,code" lines, decodes every
+// secret and builds its key schedule once, shares a single time sample
+// across the batch, fans the work over threads through the multi-buffer
+// SHA-1 kernel, and prints "<id> VALID|INVALID|MALFORMED" per line.
+// --stats wraps the base32 decode, HMAC and truncate stages in rdtsc
+// reads, accumulated per worker, and prints a cycles/op and bytes/cycle
+// table to stderr on exit.
+//
+// serve runs a long-lived daemon on a Unix domain socket so callers skip
+// process spawn and OpenSSL init on every check. Secrets live in an
+// open-addressing hash table keyed by id, holding the precomputed
+// HMAC-SHA1 key schedule; clients register each secret once with
+// "register <id> <base32-secret>" (answered "OK") instead of resending
+// it per request, and an optional secrets file of "<id> <base32-secret>"
+// lines preloads the table at startup. "verify <id> <code> [window]"
+// requests then cost one table probe plus the compression calls and get
+// back "VALID", "INVALID" or "ERR <reason>". Entries are evicted LRU
+// once the table exceeds max-mem-mib (default 256 MiB). --metrics keeps
+// verdict totals and HMAC latency histograms in a shared-memory segment
+// for the metrics_export Prometheus sidecar.
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
 #include <stdint.h>
-#include <ctype.h>
+#include <signal.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 #include <openssl/hmac.h>
 #include <openssl/evp.h>
 
-static const char *BASE32_ALPHABET = "ABCDEFGHIJKLMNOPQRSTUVWXYZ234567";
+#include "authtools.h"
+
+// ---- --stats stage accounting ----
+//
+// bulk-verify pipeline stages for --stats: base32 decode and key setup
+// happen once per line on the parse thread, HMAC and truncate run on the
+// workers. Counters are per worker; the main thread merges after join
+// and prints the table on exit. Off, each point is one NULL test.
+enum { TS_B32, TS_MAC, TS_TRUNC, TS_STAGES };
+
+static const char *const stat_stage_names[TS_STAGES] = {
+    "base32_decode", "hmac_sha1", "truncate",
+};
 
-int base32_decode(const char *encoded, unsigned char **result, size_t *out_len) {
-    size_t len = strlen(encoded);
-    size_t buffer = 0;
-    int bits_left = 0;
-    size_t count = 0;
-    unsigned char *bytes = malloc((len * 5 / 8) + 1);
-    if (!bytes) return -1;
+static int stats_enabled;
+static stat_counter stats_total[TS_STAGES];
 
-    for (size_t i = 0; i < len; ++i) {
-        char ch = encoded[i];
-        if (ch == '=' || ch == ' ') break; // padding or separator
+// Shared metrics segment (--metrics <shm-name>), mapped once in main
+// for the serve daemon; updated with relaxed atomic adds on the verify
+// path and scraped by the metrics_export sidecar. The segment's stage
+// index 1 ("mac") carries the HMAC window latency.
+static metrics_segment *metrics_seg;
 
-        ch = toupper((unsigned char)ch);
-        const char *p = strchr(BASE32_ALPHABET, ch);
-        if (!p) continue; // skip invalid
+// One "user-id,base32-secret,code" line from a bulk-verify input file.
+typedef struct {
+    const char *id;
+    size_t id_len;
+    hmac_sha1_padkey key;
+    uint32_t code;
+    signed char verdict; // 1 valid, 0 invalid, -1 malformed line
+} bulk_entry;
 
-        int val = p - BASE32_ALPHABET;
-        buffer <<= 5;
-        buffer |= val & 0x1F;
-        bits_left += 5;
-        if (bits_left >= 8) {
-            bytes[count++] = (buffer >> (bits_left - 8)) & 0xFF;
-            bits_left -= 8;
+typedef struct {
+    bulk_entry *entries;
+    size_t count;
+    uint64_t timestep; // one time sample shared by the whole batch
+    int window;
+    _Atomic size_t next; // chunked work distribution
+} bulk_job;
+
+#define BULK_CHUNK 256
+
+static int bulk_verify_entry(bulk_entry *e, uint64_t timestep, int window,
+                             stat_counter *st) {
+    int total = 2 * window + 1;
+    int matched = 0;
+    for (int base = 0; base < total; base += 4) {
+        uint64_t steps[4];
+        for (int l = 0; l < 4; ++l) {
+            int i = base + l < total ? base + l : 0;
+            steps[l] = timestep - window + i;
+        }
+        unsigned char digests[4][20];
+        uint64_t t0 = stat_begin(st);
+        hmac_sha1_counter4(&e->key, steps, digests);
+        stat_end(st, TS_MAC, t0, 4 * 8);
+        int lanes = total - base < 4 ? total - base : 4;
+        t0 = stat_begin(st);
+        for (int l = 0; l < lanes; ++l) {
+            if (totp_truncate(digests[l]) % 1000000 == e->code) matched = 1;
         }
+        stat_end(st, TS_TRUNC, t0, (uint64_t)lanes * 20);
+        if (matched) break;
     }
-    *result = bytes;
-    *out_len = count;
-    return 0;
+    return matched;
 }
 
-uint32_t truncate(const unsigned char *hmac_result) {
-    int offset = hmac_result[19] & 0x0f;
-    uint32_t bin_code = (hmac_result[offset] & 0x7f) << 24 |
-                        (hmac_result[offset + 1] & 0xff) << 16 |
-                        (hmac_result[offset + 2] & 0xff) << 8 |
-                        (hmac_result[offset + 3] & 0xff);
-    return bin_code;
-}
-
-void compute_totp(const char *base32_secret, int window, char *out_code, size_t digits) {
-    unsigned char *secret_bytes = NULL;
-    size_t secret_len = 0;
-    if (base32_decode(base32_secret, &secret_bytes, &secret_len) != 0) {
-        fprintf(stderr, "Failed to decode base32 secret\n");
-        exit(1);
-    }
-
-    time_t now = time(NULL);
-    uint64_t timestep = (uint64_t)(now / 30);
-
-    for (int i = -window; i <= window; ++i) {
-        uint64_t t = timestep + i;
-        unsigned char msg[8];
-        for (int j = 7; j >= 0; --j) {
-            msg[j] = t & 0xFF;
-            t >>= 8;
-        }
-
-        unsigned int len = EVP_MAX_MD_SIZE;
-        unsigned char *hmac_result = HMAC(EVP_sha1(), secret_bytes, (int)secret_len,
-                                         msg, sizeof(msg), NULL, NULL);
-        if (!hmac_result) continue;
-        uint32_t code = truncate(hmac_result);
-        uint32_t otp = code % (uint32_t)pow(10, digits);
-        char candidate[16];
-        snprintf(candidate, sizeof(candidate), "%0*u", (int)digits, otp);
-        // If exactly zero window, return current code
-        if (i == 0) {
-            strncpy(out_code, candidate, digits + 1);
-            free(secret_bytes);
-            return;
+// Worker handle: the shared job plus this thread's --stats counters,
+// padded so neighbouring workers never share a line.
+typedef struct {
+    bulk_job *job;
+    stat_counter stats[TS_STAGES];
+    char pad[64];
+} bulk_worker;
+
+static void *bulk_worker_main(void *arg) {
+    bulk_worker *w = arg;
+    bulk_job *job = w->job;
+    stat_counter *st = stats_enabled ? w->stats : NULL;
+    for (;;) {
+        size_t start = atomic_fetch_add(&job->next, BULK_CHUNK);
+        if (start >= job->count) break;
+        size_t end = start + BULK_CHUNK;
+        if (end > job->count) end = job->count;
+        for (size_t i = start; i < end; ++i) {
+            bulk_entry *e = &job->entries[i];
+            if (e->verdict == -1) continue;
+            e->verdict = (signed char)bulk_verify_entry(e, job->timestep,
+                                                        job->window, st);
+        }
+    }
+    return NULL;
+}
+
+// Verify "user-id,base32-secret,code" triples: each secret is decoded and
+// its key schedule built once, one time sample is shared by the whole
+// batch, and the work fans out across threads through the multi-buffer
+// SHA-1 kernel.
+static int run_bulk_verify(const char *path, int window, int nthreads) {
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        fprintf(stderr, "cannot open %s\n", path);
+        return 1;
+    }
+
+    size_t cap = 1024, count = 0;
+    bulk_entry *entries = malloc(cap * sizeof(*entries));
+    char *line = NULL;
+    size_t lcap = 0;
+    ssize_t len;
+    // lines are kept around (id points into them) until output is done
+    char **lines = NULL;
+    size_t lines_cap = 0, lines_count = 0;
+    while (entries && (len = getline(&line, &lcap, f)) != -1) {
+        while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r')) {
+            line[--len] = '\0';
+        }
+        if (len == 0 || line[0] == '#') continue;
+        if (count == cap) {
+            cap *= 2;
+            bulk_entry *grown = realloc(entries, cap * sizeof(*entries));
+            if (!grown) break;
+            entries = grown;
         }
-        // On verify path, caller will compare
+        if (lines_count == lines_cap) {
+            lines_cap = lines_cap ? lines_cap * 2 : 1024;
+            char **grown = realloc(lines, lines_cap * sizeof(*lines));
+            if (!grown) break;
+            lines = grown;
+        }
+        char *kept = strdup(line);
+        if (!kept) break;
+        lines[lines_count++] = kept;
+
+        bulk_entry *e = &entries[count++];
+        memset(e, 0, sizeof(*e));
+        e->verdict = -1;
+
+        char *save = NULL;
+        char *id = strtok_r(kept, ",", &save);
+        char *secret = strtok_r(NULL, ",", &save);
+        char *code = strtok_r(NULL, ",", &save);
+        if (!id || !secret || !code) {
+            e->id = kept;
+            e->id_len = strlen(kept);
+            continue;
+        }
+        e->id = id;
+        e->id_len = strlen(id);
+
+        unsigned char secret_bytes[128];
+        size_t secret_len = 0;
+        stat_counter *st = stats_enabled ? stats_total : NULL;
+        uint64_t t0 = stat_begin(st);
+        int dec = base32_decode_buf(secret, secret_bytes, sizeof(secret_bytes),
+                                    &secret_len);
+        stat_end(st, TS_B32, t0, strlen(secret));
+        if (dec != 0 || secret_len == 0) continue;
+        char *endp = NULL;
+        unsigned long c = strtoul(code, &endp, 10);
+        if (endp == code || *endp != '\0' || c > 999999) continue;
+        hmac_sha1_padkey_init(&e->key, secret_bytes, secret_len);
+        e->code = (uint32_t)c;
+        e->verdict = 0;
     }
-    // default fallback: current
-    uint64_t t = timestep;
-    unsigned char msg[8];
-    for (int j = 7; j >= 0; --j) {
-        msg[j] = t & 0xFF;
-        t >>= 8;
+    free(line);
+    fclose(f);
+    if (!entries) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
     }
-    unsigned char *hmac_result = HMAC(EVP_sha1(), secret_bytes, (int)secret_len,
-                                     msg, sizeof(msg), NULL, NULL);
-    uint32_t code = truncate(hmac_result);
-    uint32_t otp = code % (uint32_t)pow(10, digits);
-    snprintf(out_code, digits + 1, "%0*u", (int)digits, otp);
-    free(secret_bytes);
+
+    bulk_job job = { entries, count, (uint64_t)(time(NULL) / 30), window, 0 };
+    if (nthreads < 1) nthreads = 1;
+    pthread_t *tids = calloc(nthreads, sizeof(*tids));
+    bulk_worker *workers = calloc(nthreads, sizeof(*workers));
+    for (int t = 0; t < nthreads; ++t) workers[t].job = &job;
+    for (int t = 1; t < nthreads; ++t) {
+        if (pthread_create(&tids[t], NULL, bulk_worker_main, &workers[t]) != 0) {
+            tids[t] = 0;
+        }
+    }
+    bulk_worker_main(&workers[0]);
+    for (int t = 1; t < nthreads; ++t) {
+        if (tids[t]) pthread_join(tids[t], NULL);
+    }
+    if (stats_enabled) {
+        for (int t = 0; t < nthreads; ++t) {
+            for (int s = 0; s < TS_STAGES; ++s) {
+                stats_total[s].cycles += workers[t].stats[s].cycles;
+                stats_total[s].bytes += workers[t].stats[s].bytes;
+                stats_total[s].ops += workers[t].stats[s].ops;
+            }
+        }
+    }
+    free(workers);
+    free(tids);
+
+    for (size_t i = 0; i < count; ++i) {
+        const char *verdict = entries[i].verdict == 1 ? "VALID"
+                            : entries[i].verdict == 0 ? "INVALID" : "MALFORMED";
+        printf("%.*s %s\n", (int)entries[i].id_len, entries[i].id, verdict);
+    }
+
+    for (size_t i = 0; i < lines_count; ++i) free(lines[i]);
+    free(lines);
+    free(entries);
+    return 0;
 }
 
-int verify_totp(const char *secret, const char *code, int window) {
-    char expected[16];
-    for (int i = -window; i <= window; ++i) {
-        unsigned char *secret_bytes = NULL;
+
+// ---- bulk pregeneration ----
+//
+// Drift-monitoring dashboards need the expected code for every enrolled
+// seed each timestep. pregen decodes and keys all seeds once, shares a
+// single time sample across the batch, and fills four lanes of the
+// multi-buffer SHA-1 kernel with four different keys per call
+// (hmac_sha1_key4) - one vector compression pair per four codes. With
+// steps=2 the next timestep's codes are emitted too, so the dashboard
+// can prefetch across the window boundary.
+
+#define PREGEN_MAX_STEPS 2
+
+typedef struct {
+    const char *id;
+    size_t id_len;
+    hmac_sha1_padkey key;
+    char codes[PREGEN_MAX_STEPS][8];
+    signed char ok; // 0 = malformed line, skipped
+} pregen_entry;
+
+typedef struct {
+    pregen_entry *entries;
+    size_t count;
+    uint64_t timestep;
+    int steps;
+    _Atomic size_t next;
+} pregen_job;
+
+static void *pregen_worker_main(void *arg) {
+    pregen_job *job = arg;
+    for (;;) {
+        size_t start = atomic_fetch_add(&job->next, BULK_CHUNK);
+        if (start >= job->count) break;
+        size_t end = start + BULK_CHUNK;
+        if (end > job->count) end = job->count;
+        for (size_t i = start; i < end; i += 4) {
+            // four keys per kernel call; malformed lines leave a lane
+            // repeating a neighbour's key, ignored on output
+            pregen_entry *lane[4];
+            const hmac_sha1_padkey *keys[4];
+            int lanes = 0;
+            for (size_t j = i; j < end && j < i + 4; ++j) {
+                if (job->entries[j].ok) lane[lanes++] = &job->entries[j];
+            }
+            if (lanes == 0) continue;
+            for (int l = 0; l < 4; ++l) {
+                keys[l] = &lane[l < lanes ? l : lanes - 1]->key;
+            }
+            for (int st = 0; st < job->steps; ++st) {
+                unsigned char digests[4][20];
+                hmac_sha1_key4(keys, job->timestep + (uint64_t)st, digests);
+                for (int l = 0; l < lanes; ++l) {
+                    uint32_t code = totp_truncate(digests[l]) % totp_pow10[6];
+                    totp_format_code(code, 6, lane[l]->codes[st]);
+                }
+            }
+        }
+    }
+    return NULL;
+}
+
+// Stream "id,code[,nextcode]" for every "id,base32" line in the secrets
+// file (extra fields are ignored, so bulk-verify triple files work too).
+static int run_pregen(const char *path, int steps, int nthreads) {
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        fprintf(stderr, "cannot open %s\n", path);
+        return 1;
+    }
+
+    size_t cap = 1024, count = 0;
+    pregen_entry *entries = malloc(cap * sizeof(*entries));
+    char *line = NULL;
+    size_t lcap = 0;
+    ssize_t len;
+    // lines are kept around (id points into them) until output is done
+    char **lines = NULL;
+    size_t lines_cap = 0, lines_count = 0;
+    while (entries && (len = getline(&line, &lcap, f)) != -1) {
+        while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r')) {
+            line[--len] = '\0';
+        }
+        if (len == 0 || line[0] == '#') continue;
+        if (count == cap) {
+            cap *= 2;
+            pregen_entry *grown = realloc(entries, cap * sizeof(*entries));
+            if (!grown) break;
+            entries = grown;
+        }
+        if (lines_count == lines_cap) {
+            lines_cap = lines_cap ? lines_cap * 2 : 1024;
+            char **grown = realloc(lines, lines_cap * sizeof(*lines));
+            if (!grown) break;
+            lines = grown;
+        }
+        char *kept = strdup(line);
+        if (!kept) break;
+        lines[lines_count++] = kept;
+
+        pregen_entry *e = &entries[count++];
+        memset(e, 0, sizeof(*e));
+
+        char *save = NULL;
+        char *id = strtok_r(kept, ",", &save);
+        char *secret = strtok_r(NULL, ",", &save);
+        if (!id || !secret) {
+            e->id = kept;
+            e->id_len = strlen(kept);
+            continue;
+        }
+        e->id = id;
+        e->id_len = strlen(id);
+
+        unsigned char secret_bytes[128];
         size_t secret_len = 0;
-        if (base32_decode(secret, &secret_bytes, &secret_len) != 0) {
+        if (base32_decode_buf(secret, secret_bytes, sizeof(secret_bytes),
+                              &secret_len) != 0 || secret_len == 0) {
             continue;
         }
-        time_t now = time(NULL);
-        uint64_t timestep = (uint64_t)(now / 30) + i;
-        unsigned char msg[8];
-        uint64_t t = timestep;
-        for (int j = 7; j >= 0; --j) {
-            msg[j] = t & 0xFF;
-            t >>= 8;
-        }
-        unsigned char *hmac_result = HMAC(EVP_sha1(), secret_bytes, (int)secret_len,
-                                         msg, sizeof(msg), NULL, NULL);
-        uint32_t code_int = truncate(hmac_result);
-        uint32_t otp = code_int % 1000000;
-        snprintf(expected, sizeof(expected), "%06u", otp);
-        free(secret_bytes);
-        if (strcmp(expected, code) == 0) return 1;
+        hmac_sha1_padkey_init(&e->key, secret_bytes, secret_len);
+        e->ok = 1;
+    }
+    free(line);
+    fclose(f);
+    if (!entries) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+
+    pregen_job job = { entries, count, (uint64_t)(time(NULL) / 30), steps, 0 };
+    if (nthreads < 1) nthreads = 1;
+    pthread_t *tids = calloc(nthreads, sizeof(*tids));
+    for (int t = 1; t < nthreads; ++t) {
+        if (pthread_create(&tids[t], NULL, pregen_worker_main, &job) != 0) {
+            tids[t] = 0;
+        }
+    }
+    pregen_worker_main(&job);
+    for (int t = 1; t < nthreads; ++t) {
+        if (tids[t]) pthread_join(tids[t], NULL);
+    }
+    free(tids);
+
+    for (size_t i = 0; i < count; ++i) {
+        pregen_entry *e = &entries[i];
+        if (!e->ok) continue;
+        if (steps == 2) {
+            printf("%.*s,%s,%s\n", (int)e->id_len, e->id, e->codes[0],
+                   e->codes[1]);
+        } else {
+            printf("%.*s,%s\n", (int)e->id_len, e->id, e->codes[0]);
+        }
     }
+
+    for (size_t i = 0; i < lines_count; ++i) free(lines[i]);
+    free(lines);
+    free(entries);
     return 0;
 }
 
+// ---- daemon secret cache ----
+//
+// Open-addressing hash table of id -> precomputed HMAC-SHA1 key schedule.
+// A verify request costs one probe sequence plus the compression calls;
+// nothing is decoded or re-keyed per request. Clients register secrets
+// once ("register <id> <base32>") instead of resending them per call.
+// Live entries form an intrusive LRU list and the least recently used is
+// evicted once the cache exceeds its memory cap, since the enrolled-user
+// population (millions) can exceed what we want resident.
+
+#define LRU_NIL UINT32_MAX
+
+// One cached secret. Only the 40-byte pad-key schedule is kept; the
+// decoded secret bytes themselves are never needed again after keying.
+typedef struct {
+    char *id;          // NULL = empty slot, SECRET_TOMB = deleted
+    hmac_sha1_padkey key;
+    uint32_t lru_prev, lru_next;
+} secret_entry;
+
+static char secret_tomb_marker;
+#define SECRET_TOMB (&secret_tomb_marker)
+
+typedef struct {
+    secret_entry *slots;
+    uint32_t cap;        // power of two
+    uint32_t used;       // live entries
+    uint32_t tombs;      // deleted slots awaiting rehash
+    uint32_t lru_head;   // most recently used
+    uint32_t lru_tail;   // eviction candidate
+    size_t mem;          // approximate bytes held by live entries
+    size_t mem_cap;
+} secret_cache;
+
+static uint64_t hash_id(const char *id) {
+    uint64_t h = 1469598103934665603ull; // FNV-1a
+    for (const unsigned char *p = (const unsigned char *)id; *p; ++p) {
+        h = (h ^ *p) * 1099511628211ull;
+    }
+    return h;
+}
+
+static int cache_init(secret_cache *c, size_t mem_cap) {
+    c->cap = 1024;
+    c->slots = calloc(c->cap, sizeof(*c->slots));
+    c->used = c->tombs = 0;
+    c->lru_head = c->lru_tail = LRU_NIL;
+    c->mem = 0;
+    c->mem_cap = mem_cap;
+    return c->slots ? 0 : -1;
+}
+
+static void lru_unlink(secret_cache *c, uint32_t idx) {
+    secret_entry *e = &c->slots[idx];
+    if (e->lru_prev != LRU_NIL) c->slots[e->lru_prev].lru_next = e->lru_next;
+    else c->lru_head = e->lru_next;
+    if (e->lru_next != LRU_NIL) c->slots[e->lru_next].lru_prev = e->lru_prev;
+    else c->lru_tail = e->lru_prev;
+}
+
+static void lru_push_front(secret_cache *c, uint32_t idx) {
+    secret_entry *e = &c->slots[idx];
+    e->lru_prev = LRU_NIL;
+    e->lru_next = c->lru_head;
+    if (c->lru_head != LRU_NIL) c->slots[c->lru_head].lru_prev = idx;
+    c->lru_head = idx;
+    if (c->lru_tail == LRU_NIL) c->lru_tail = idx;
+}
+
+static void cache_touch(secret_cache *c, uint32_t idx) {
+    if (c->lru_head == idx) return;
+    lru_unlink(c, idx);
+    lru_push_front(c, idx);
+}
+
+// Linear probe for id. Returns the slot index, or the first insertable
+// slot (empty or tombstone) with *found = 0.
+static uint32_t cache_probe(const secret_cache *c, const char *id, int *found) {
+    uint32_t mask = c->cap - 1;
+    uint32_t i = (uint32_t)hash_id(id) & mask;
+    uint32_t insert = LRU_NIL;
+    for (;;) {
+        const secret_entry *e = &c->slots[i];
+        if (e->id == NULL) {
+            *found = 0;
+            return insert != LRU_NIL ? insert : i;
+        }
+        if (e->id == SECRET_TOMB) {
+            if (insert == LRU_NIL) insert = i;
+        } else if (strcmp(e->id, id) == 0) {
+            *found = 1;
+            return i;
+        }
+        i = (i + 1) & mask;
+    }
+}
+
+static size_t entry_mem(const secret_entry *e) {
+    return sizeof(*e) + strlen(e->id) + 1;
+}
+
+static void cache_evict_lru(secret_cache *c) {
+    uint32_t idx = c->lru_tail;
+    if (idx == LRU_NIL) return;
+    lru_unlink(c, idx);
+    c->mem -= entry_mem(&c->slots[idx]);
+    free(c->slots[idx].id);
+    c->slots[idx].id = SECRET_TOMB;
+    --c->used;
+    ++c->tombs;
+}
+
+// Rebuild the table (doubling when load demands it) to shed tombstones.
+static int cache_rehash(secret_cache *c) {
+    uint32_t new_cap = c->cap;
+    if (c->used * 4 >= c->cap * 3) new_cap *= 2;
+    secret_cache fresh = *c;
+    fresh.cap = new_cap;
+    fresh.slots = calloc(new_cap, sizeof(*fresh.slots));
+    if (!fresh.slots) return -1;
+    fresh.tombs = 0;
+    fresh.lru_head = fresh.lru_tail = LRU_NIL;
+
+    // walk the LRU list oldest-first so push_front rebuilds it intact
+    for (uint32_t idx = c->lru_tail; idx != LRU_NIL;
+         idx = c->slots[idx].lru_prev) {
+        int found;
+        uint32_t j = cache_probe(&fresh, c->slots[idx].id, &found);
+        fresh.slots[j] = c->slots[idx];
+        lru_push_front(&fresh, j);
+    }
+    free(c->slots);
+    *c = fresh;
+    return 0;
+}
+
+// Insert or replace id -> key schedule, evicting LRU entries to stay
+// under the memory cap. Returns 0 on success.
+static int cache_insert(secret_cache *c, const char *id,
+                        const hmac_sha1_padkey *key) {
+    // keep the probe sequences short: rehash at 3/4 occupancy
+    if ((c->used + c->tombs) * 4 >= c->cap * 3) {
+        if (cache_rehash(c) != 0) return -1;
+    }
+    int found;
+    uint32_t idx = cache_probe(c, id, &found);
+    secret_entry *e = &c->slots[idx];
+    if (found) {
+        e->key = *key;
+        cache_touch(c, idx);
+        return 0;
+    }
+    char *dup = strdup(id);
+    if (!dup) return -1;
+    if (e->id == SECRET_TOMB) --c->tombs;
+    e->id = dup;
+    e->key = *key;
+    ++c->used;
+    c->mem += entry_mem(e);
+    lru_push_front(c, idx);
+    while (c->mem > c->mem_cap && c->used > 1) cache_evict_lru(c);
+    return 0;
+}
+
+// Preload "<id> <base32-secret>" lines. Returns entry count, or -1.
+static int load_secrets(const char *path, secret_cache *cache) {
+    FILE *f = fopen(path, "r");
+    if (!f) return -1;
+
+    int count = 0;
+    char *line = NULL;
+    size_t lcap = 0;
+    ssize_t len;
+    while ((len = getline(&line, &lcap, f)) != -1) {
+        while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r')) {
+            line[--len] = '\0';
+        }
+        if (len == 0 || line[0] == '#') continue;
+        char *sep = strpbrk(line, " \t,");
+        if (!sep) continue;
+        *sep = '\0';
+        const char *secret = sep + 1;
+        while (*secret == ' ' || *secret == '\t') ++secret;
+
+        unsigned char secret_bytes[128];
+        size_t secret_len = 0;
+        if (base32_decode_buf(secret, secret_bytes, sizeof(secret_bytes),
+                              &secret_len) != 0 || secret_len == 0) {
+            fprintf(stderr, "skipping %s: bad base32 secret\n", line);
+            continue;
+        }
+        hmac_sha1_padkey key;
+        hmac_sha1_padkey_init(&key, secret_bytes, secret_len);
+        if (cache_insert(cache, line, &key) == 0) ++count;
+    }
+    free(line);
+    fclose(f);
+    return count;
+}
+
+// Answer one request line into resp:
+//   register <id> <base32-secret>
+//   verify <id> <code> [window]
+static void serve_request(secret_cache *cache, char *req, char *resp,
+                          size_t resp_cap) {
+    char *save = NULL;
+    const char *cmd = strtok_r(req, " \t", &save);
+    const char *id = strtok_r(NULL, " \t", &save);
+    const char *arg = strtok_r(NULL, " \t", &save);
+    const char *window_arg = strtok_r(NULL, " \t", &save);
+
+    if (cmd && strcmp(cmd, "register") == 0 && id && arg) {
+        unsigned char secret_bytes[128];
+        size_t secret_len = 0;
+        if (base32_decode_buf(arg, secret_bytes, sizeof(secret_bytes),
+                              &secret_len) != 0 || secret_len == 0) {
+            snprintf(resp, resp_cap, "ERR bad-secret\n");
+            return;
+        }
+        hmac_sha1_padkey key;
+        hmac_sha1_padkey_init(&key, secret_bytes, secret_len);
+        snprintf(resp, resp_cap,
+                 cache_insert(cache, id, &key) == 0 ? "OK\n" : "ERR no-mem\n");
+        return;
+    }
+    if (!cmd || strcmp(cmd, "verify") != 0 || !id || !arg) {
+        snprintf(resp, resp_cap, "ERR bad-request\n");
+        return;
+    }
+    int found;
+    uint32_t idx = cache_probe(cache, id, &found);
+    if (!found) {
+        snprintf(resp, resp_cap, "ERR unknown-id\n");
+        return;
+    }
+    cache_touch(cache, idx);
+    uint32_t code_val;
+    if (totp_parse_code(arg, 6, &code_val) != 0) {
+        snprintf(resp, resp_cap, "ERR bad-code\n");
+        return;
+    }
+    int window = window_arg ? atoi(window_arg) : 1;
+    if (window < 0 || window > 10) window = 1;
+
+    uint64_t timestep = (uint64_t)(time(NULL) / 30);
+    int ok = 0;
+    uint64_t t0 = metrics_seg ? stat_cycles() : 0;
+    for (int i = -window; i <= window && !ok; ++i) {
+        unsigned char digest[20];
+        hmac_sha1_counter1(&cache->slots[idx].key, timestep + i, digest);
+        if (totp_truncate(digest) % 1000000 == code_val) ok = 1;
+    }
+    if (metrics_seg) {
+        metrics_stage_sample(metrics_seg, 1, stat_cycles() - t0);
+        metrics_add(&metrics_seg->verdicts[ok ? 0 : 1], 1);
+    }
+    snprintf(resp, resp_cap, ok ? "VALID\n" : "INVALID\n");
+}
+
+// Handle one connection: newline-delimited requests until EOF.
+static void serve_connection(int fd, secret_cache *cache) {
+    char buf[1024];
+    size_t have = 0;
+    ssize_t n;
+    while ((n = read(fd, buf + have, sizeof(buf) - have - 1)) > 0) {
+        have += (size_t)n;
+        buf[have] = '\0';
+        char *start = buf;
+        char *nl;
+        while ((nl = memchr(start, '\n', have - (start - buf))) != NULL) {
+            *nl = '\0';
+            char resp[64];
+            serve_request(cache, start, resp, sizeof(resp));
+            if (write(fd, resp, strlen(resp)) < 0) return;
+            start = nl + 1;
+        }
+        have -= start - buf;
+        memmove(buf, start, have);
+        if (have == sizeof(buf) - 1) return; // oversized request line
+    }
+}
+
+#define SERVE_DEFAULT_MEM_MIB 256
+
+static int run_serve(const char *sock_path, const char *secrets_path,
+                     int mem_cap_mib) {
+    secret_cache cache;
+    if (mem_cap_mib <= 0) mem_cap_mib = SERVE_DEFAULT_MEM_MIB;
+    if (cache_init(&cache, (size_t)mem_cap_mib << 20) != 0) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+    if (secrets_path) {
+        int count = load_secrets(secrets_path, &cache);
+        if (count < 0) {
+            fprintf(stderr, "cannot load secrets from %s\n", secrets_path);
+            return 1;
+        }
+        fprintf(stderr, "loaded %d secrets\n", count);
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+    int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (sock < 0) {
+        perror("socket");
+        return 1;
+    }
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", sock_path);
+    unlink(sock_path);
+    if (bind(sock, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+        listen(sock, 64) != 0) {
+        perror("bind/listen");
+        close(sock);
+        return 1;
+    }
+
+    for (;;) {
+        int fd = accept(sock, NULL, NULL);
+        if (fd < 0) continue;
+        serve_connection(fd, &cache);
+        close(fd);
+    }
+}
+
 int main(int argc, char **argv) {
+    // --stats / --metrics can appear anywhere; strip before positional
+    // parsing
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--stats") == 0) {
+            stats_enabled = 1;
+            memmove(&argv[i], &argv[i + 1], (argc - i - 1) * sizeof(*argv));
+            --argc;
+            --i;
+        } else if (strcmp(argv[i], "--metrics") == 0 && i + 1 < argc) {
+            metrics_seg = metrics_map(argv[i + 1], 1);
+            if (!metrics_seg) {
+                fprintf(stderr, "cannot map metrics segment %s\n",
+                        argv[i + 1]);
+                return 1;
+            }
+            memmove(&argv[i], &argv[i + 2], (argc - i - 2) * sizeof(*argv));
+            argc -= 2;
+            --i;
+        }
+    }
     if (argc < 3) {
-        fprintf(stderr, "Usage:\n  %s generate <base32-secret>\n  %s verify <base32-secret> <code> [window]\n", argv[0], argv[0]);
+        fprintf(stderr, "Usage:\n  %s generate <base32-secret>\n  %s verify <base32-secret> <code> [window]\n  %s serve <socket-path> [secrets-file] [max-mem-mib]\n  %s bulk-verify <triples-file> [window] [threads]\n  %s pregen <secrets-file> [steps] [threads]\n", argv[0], argv[0], argv[0], argv[0], argv[0]);
         return 1;
     }
     const char *cmd = argv[1];
     const char *secret = argv[2];
-    if (strcmp(cmd, "generate") == 0) {
+    if (strcmp(cmd, "serve") == 0) {
+        const char *secrets_path = argc >= 4 ? argv[3] : NULL;
+        int mem_cap_mib = argc >= 5 ? atoi(argv[4]) : 0;
+        return run_serve(argv[2], secrets_path, mem_cap_mib);
+    } else if (strcmp(cmd, "pregen") == 0) {
+        int steps = argc >= 4 ? atoi(argv[3]) : 1;
+        int nthreads = argc >= 5 ? atoi(argv[4]) : 1;
+        if (steps < 1 || steps > PREGEN_MAX_STEPS) steps = 1;
+        return run_pregen(argv[2], steps, nthreads);
+    } else if (strcmp(cmd, "bulk-verify") == 0) {
+        int window = argc >= 4 ? atoi(argv[3]) : 1;
+        int nthreads = argc >= 5 ? atoi(argv[4]) : 1;
+        if (window < 0 || window > 10) window = 1;
+        int rc = run_bulk_verify(argv[2], window, nthreads);
+        if (stats_enabled) {
+            stat_report(stat_stage_names, stats_total, TS_STAGES);
+        }
+        return rc;
+    } else if (strcmp(cmd, "generate") == 0) {
         char code[16] = {0};
         compute_totp(secret, 0, code, 6);
         printf("TOTP: %s\n", code);
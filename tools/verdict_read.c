@@ -0,0 +1,106 @@
+// Reader for the jwt_verify --output-format binary verdict stream.
+// Build with: make tools
+// Usage:
+//   ./verdict_read [stream-file]
+//
+// Validates the stream magic, then prints one text line per record:
+// "<index> VALID|INVALID|MALFORMED", with " exp=<value>" appended when
+// the record carries an exp claim. Records arrive in whatever order the
+// producing workers flushed them; each line carries its own global
+// index, so consumers that need input order can sort on the first
+// column. Reads a file when given one, stdin otherwise, so it drops
+// into a pipeline after jwt_verify or over a saved stream.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+
+#include "authtools.h"
+
+#define READ_RECS 16384 // records per fread, ~384 KiB
+
+int main(int argc, char **argv) {
+    if (argc > 2) {
+        fprintf(stderr, "Usage: %s [stream-file]\n", argv[0]);
+        return 1;
+    }
+    FILE *in = stdin;
+    if (argc == 2) {
+        in = fopen(argv[1], "rb");
+        if (!in) {
+            fprintf(stderr, "cannot open %s\n", argv[1]);
+            return 1;
+        }
+    }
+
+    uint64_t magic = 0;
+    if (fread(&magic, sizeof(magic), 1, in) != 1 || magic != VOUT_MAGIC) {
+        fprintf(stderr, "not a jwt_verify binary verdict stream\n");
+        if (in != stdin) fclose(in);
+        return 1;
+    }
+
+    // worst-case line: 20-digit index, "MALFORMED", 19-digit exp = 56
+    // bytes with the newline and terminator
+    const size_t out_cap = READ_RECS * 64;
+    verdict_rec *recs = malloc(READ_RECS * sizeof(*recs));
+    char *out = malloc(out_cap);
+    if (!recs || !out) {
+        fprintf(stderr, "out of memory\n");
+        free(recs);
+        free(out);
+        if (in != stdin) fclose(in);
+        return 1;
+    }
+
+    int rc = 0;
+    size_t n;
+    while ((n = fread(recs, sizeof(*recs), READ_RECS, in)) > 0) {
+        size_t len = 0;
+        for (size_t i = 0; i < n; ++i) {
+            const verdict_rec *r = &recs[i];
+            // any out-of-range verdict in a corrupt stream reads as
+            // MALFORMED; the capacity check below keeps even crafted
+            // records from overrunning the buffer
+            const char *verdict = r->verdict == 1 ? "VALID"
+                                : r->verdict == 0 ? "INVALID" : "MALFORMED";
+            int w;
+            if (r->exp >= 0) {
+                w = snprintf(out + len, out_cap - len, "%llu %s exp=%lld\n",
+                             (unsigned long long)r->index, verdict,
+                             (long long)r->exp);
+            } else {
+                w = snprintf(out + len, out_cap - len, "%llu %s\n",
+                             (unsigned long long)r->index, verdict);
+            }
+            if (w < 0 || (size_t)w >= out_cap - len) {
+                fprintf(stderr, "output buffer overrun\n");
+                rc = 1;
+                break;
+            }
+            len += (size_t)w;
+        }
+        if (rc) break;
+        if (fwrite(out, 1, len, stdout) != len) {
+            rc = 1;
+            break;
+        }
+    }
+    if (ferror(in)) {
+        fprintf(stderr, "read error: %s\n", strerror(errno));
+        rc = 1;
+    } else if (!rc && ftell(in) >= 0) {
+        // a truncated trailing record means the producer died mid-flush
+        long pos = ftell(in);
+        if (pos > 0 && ((size_t)pos - sizeof(magic)) % sizeof(verdict_rec)) {
+            fprintf(stderr, "warning: truncated trailing record\n");
+        }
+    }
+
+    free(recs);
+    free(out);
+    if (in != stdin) fclose(in);
+    return rc;
+}